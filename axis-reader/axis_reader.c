@@ -36,6 +36,7 @@
 #include <linux/init.h>
 #include <linux/module.h>
 #include <linux/slab.h>
+#include <linux/string.h>
 
 #include <linux/device.h>
 #include <linux/cdev.h>
@@ -49,9 +50,16 @@
 #include <linux/ioctl.h>
 #include <asm/ioctls.h>
 
+/* xilinx_dma_get_app_words() is looked up with symbol_get() so this module
+ * still loads with the xilinx-dma-dr driver alone.
+ */
+#include "../xilinx-dma-sg/xilinx_dma_sg.h"
+#include "axis_reader.h"
+
 #define IS_NULL(x) (x == NULL)
 #define DRIVER_NAME "axis-reader"
 
+
 /* Simple example of how to receive command line parameters to your module.
    Delete if you don't need them */
 int max_packet_length = 1*1024*1024;
@@ -70,6 +78,7 @@ struct ar_transaction
         dma_addr_t       dma_buffer_addr;        ///< DMA buffer physical memory address.
         u32              dma_buffer_len;         ///< Requested length of the DMA transfer.
         u32              dma_completed_len;      ///< Actual length of completed transaction.
+        u32              app[AR_APP_WORDS];      ///< Status stream APP words of the packet.
 };
 
 struct ar_channel
@@ -80,6 +89,7 @@ struct ar_channel
 
         /* DMA */
         struct dma_chan *dma;                    ///< DMA channel.
+        int (*get_app_words)(struct dma_chan *, dma_cookie_t, u32 *);  ///< NULL unless the channel is from xilinx-dma-sg.
 
         /* Transactions */
         struct list_head free_transactions;
@@ -139,12 +149,21 @@ static void ar_transaction_callback(void *transaction)
                         dev_warn(ch->dev_entry,
                                 "DMA transaction residue is negative.\n");
 
+                ch->status_error++;
+
+                /* Both DMA drivers recover from an error by themselves,
+                 * only the transaction the engine halted on fails.  Resubmit
+                 * it to keep the number of pending transactions up.
+                 */
+                if (status == DMA_ERROR && !ar_transaction_submit(tx)) {
+                        ar_transactions_start(ch);
+                        return;
+                }
+
                 /* Move transaction to free list. */
                 spin_lock_irqsave(&ch->lock, flags);
                 list_move_tail(&tx->node, &ch->free_transactions);
                 spin_unlock_irqrestore(&ch->lock, flags);
-
-                ch->status_error++;
                 return;
         }
 
@@ -152,6 +171,12 @@ static void ar_transaction_callback(void *transaction)
          */
         tx->dma_completed_len = tx->dma_buffer_len - state.residue;
 
+        /* Keep the packet metadata while the DMA driver still has it.
+         */
+        if (!ch->get_app_words ||
+            ch->get_app_words(ch->dma, tx->dma_cookie, tx->app))
+                memset(tx->app, 0, sizeof(tx->app));
+
         /* All of the list operations should be atomic, just to be safe.
          */
         spin_lock_irqsave(&ch->lock, flags);
@@ -249,10 +274,11 @@ static struct ar_transaction * ar_transaction_create(struct ar_channel* chan)
         tx->channel = chan;
         tx->dma_buffer_len = max_packet_length;
 
-        /* Allocate DMA space.
+        /* Allocate DMA space against the DMA controller, so the buffer is
+         * placed according to its DMA mask (set from the core's address
+         * width) and never needs bouncing.
          */
-        dma_set_coherent_mask(chan->dev_entry, 0xFFFFFFFF);
-        tx->dma_buffer = dmam_alloc_coherent(chan->dev_entry,
+        tx->dma_buffer = dma_alloc_coherent(chan->dma->device->dev,
                 tx->dma_buffer_len, &tx->dma_buffer_addr, GFP_KERNEL);
         if (!tx->dma_buffer) {
                 dev_err(chan->dev_entry, "Failed to allocate DMA continuous"
@@ -268,7 +294,7 @@ static void ar_transaction_destroy(struct ar_transaction* tx)
 {
         /* If the transaction is in a list, lets remove it from the list first. */
 
-        dmam_free_coherent(tx->channel->dev_entry, tx->dma_buffer_len,
+        dma_free_coherent(tx->channel->dma->device->dev, tx->dma_buffer_len,
                 tx->dma_buffer, tx->dma_buffer_addr);
         devm_kfree(tx->channel->dev_entry, tx);
 }
@@ -510,6 +536,7 @@ static long arf_unlocked_ioctl(struct file *file, unsigned int cmd, unsigned lon
 {
     unsigned int nextTxLength;
     unsigned long flags;
+    struct ar_packet_meta meta;
     struct ar_transaction *tx = NULL;
     struct ar_channel *ch = file->private_data;
 
@@ -523,6 +550,19 @@ static long arf_unlocked_ioctl(struct file *file, unsigned int cmd, unsigned lon
         copy_to_user((void*)arg, &nextTxLength, sizeof(nextTxLength));
         return 0;
 
+    case AR_IOCGMETA:
+        memset(&meta, 0, sizeof(meta));
+        spin_lock_irqsave(&ch->lock, flags);
+        tx = list_first_entry_or_null(&ch->completed_transactions, struct ar_transaction, node);
+        if (tx != NULL) {
+            meta.length = tx->dma_completed_len;
+            memcpy(meta.app, tx->app, sizeof(meta.app));
+        }
+        spin_unlock_irqrestore(&ch->lock, flags);
+        if (copy_to_user((void*)arg, &meta, sizeof(meta)))
+            return -EFAULT;
+        return 0;
+
     }
     return -EINVAL;
 }
@@ -639,6 +679,11 @@ static void ar_channel_exit(struct ar_channel* chan)
                 dma_release_channel(chan->dma);
         }
 
+        if (chan->get_app_words) {
+                symbol_put(xilinx_dma_get_app_words);
+                chan->get_app_words = NULL;
+        }
+
         ar_chardev_destroy(chan);
 }
 
@@ -662,14 +707,27 @@ static int ar_channel_init(struct ar_channel* chan)
                 return -ENODEV;
         }
 
+        /* Packet metadata (APP words) is only available from the SG driver.
+         */
+        if (!strcmp(dev_driver_string(chan->dma->device->dev), "xilinx-dma-sg"))
+                chan->get_app_words = symbol_get(xilinx_dma_get_app_words);
+
         err = ar_chardev_create(chan);
         if (err) {
                 ar_chardev_destroy(chan);
+                if (chan->get_app_words) {
+                        symbol_put(xilinx_dma_get_app_words);
+                        chan->get_app_words = NULL;
+                }
+                dma_release_channel(chan->dma);
+                chan->dma = NULL;
                 return err;
         }
 
         /* Create some number of free transactions.
-         * Must be done after chardev creation because we use the chardev device number in the CMA request.
+         * Must be done after chardev creation because the transaction
+         * structures are devm allocated against the chardev device.  Their
+         * DMA buffers are allocated against the DMA controller.
          */
         for (i = 0; i < 4; i++) {
                 struct ar_transaction *tx = ar_transaction_create(chan);
@@ -0,0 +1,27 @@
+/* This header file is shared between the axis-reader driver and the
+ * applications reading /dev/axisreader<n>.  It defines the ioctl interface
+ * of the character device.
+ */
+
+#ifndef AXIS_READER_H
+#define AXIS_READER_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/* Packet metadata returned by the AR_IOCGMETA ioctl for the next packet
+ * read() will return, zeroed if there is none.  The APP words are the
+ * status stream of the packet, only filled in with the xilinx-dma-sg driver.
+ */
+#define AR_APP_WORDS 5
+
+struct ar_packet_meta
+{
+        __u32 length;                            ///< Packet length, as returned by FIONREAD.
+        __u32 app[AR_APP_WORDS];                 ///< Status stream APP words.
+};
+
+#define AR_IOC_MAGIC 'a'
+#define AR_IOCGMETA _IOR(AR_IOC_MAGIC, 1, struct ar_packet_meta)
+
+#endif /* AXIS_READER_H */
@@ -21,16 +21,24 @@
 
 #include <linux/dma/xilinx_dma.h>
 #include <linux/bitops.h>
+#include <linux/debugfs.h>
+#include <linux/dma-mapping.h>
 #include <linux/init.h>
 #include <linux/interrupt.h>
 #include <linux/io.h>
 #include <linux/iopoll.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
 #include <linux/of_address.h>
 #include <linux/of_dma.h>
 #include <linux/of_irq.h>
 #include <linux/of_platform.h>
+#include <linux/sched.h>
+#include <linux/percpu.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
+#include <linux/workqueue.h>
 
 #include "dmaengine.h"
 
@@ -70,6 +78,27 @@
 #define XILINX_DMA_TX_HISTORY           32
 #define XILINX_DMA_PERIPHERAL_ID	0x000A3500
 
+/* Time a healthy channel is given to finish its active transfer before the
+ * error recovery resets the core under it.
+ */
+#define XILINX_DMA_RECOVER_DRAIN_US	1000
+
+/* Statistics histograms, bucket N counts times in [2^(N-1), 2^N) us. */
+#define XILINX_DMA_STATS_HIST_BUCKETS	16
+
+
+/* Completion processing, see xilinx_dma_completion_thread_start(). */
+static bool completion_thread;
+module_param(completion_thread, bool, S_IRUGO);
+MODULE_PARM_DESC(completion_thread, "Run completions (callbacks) in a kernel thread per channel instead of a tasklet");
+
+static int completion_cpu = -1;
+module_param(completion_cpu, int, S_IRUGO);
+MODULE_PARM_DESC(completion_cpu, "CPU the completion threads run on, -1 for any");
+
+static unsigned int completion_priority;
+module_param(completion_priority, uint, S_IRUGO);
+MODULE_PARM_DESC(completion_priority, "SCHED_FIFO priority of the completion threads (1-99), 0 for SCHED_NORMAL");
 
 #define xilinx_dma_poll_timeout(chan, reg, val, cond, delay_us, timeout_us) \
 	readl_poll_timeout(chan->xdev->regs + chan->ctrl_offset + reg, val, \
@@ -79,6 +108,16 @@
  * struct xilinx_dma_tx_descriptor - Per Transaction structure
  * @async_tx: Async transaction descriptor
  * @node: Node in the channel descriptors list
+ * @start_time: Time the transaction was handed to the hardware
+ * @irq_time: Time the completion interrupt was taken
+ * @cyclic: Transaction is a cyclic ring of periods (requested_length is the
+ *          ring length)
+ * @period_len: Length of one period of a cyclic transaction
+ * @num_periods: Number of periods in the ring of a cyclic transaction
+ * @period: Period the hardware is currently transferring
+ * @periods_elapsed: Periods completed but not yet reported by the tasklet
+ * @stalled: Cyclic transaction was not re-armed because the channel is paused
+ * @error: Transaction was completed by an error interrupt
  */
 struct xilinx_dma_tx_descriptor {
 	struct dma_async_tx_descriptor async_tx;
@@ -87,6 +126,42 @@ struct xilinx_dma_tx_descriptor {
 	u32 requested_length;
 	u32 transferred_length;
 	u32 * transferred_length_ptr;
+
+	ktime_t start_time;
+	ktime_t irq_time;
+
+	bool cyclic;
+	u32 period_len;
+	u32 num_periods;
+	u32 period;
+	u32 periods_elapsed;
+	bool stalled;
+	bool error;
+};
+
+/**
+ * struct xilinx_dma_chan_stats - Per-CPU channel statistics
+ * @irqs: Interrupts handled
+ * @spurious_irqs: Completion interrupts without an active transaction
+ * @completed: Transactions completed
+ * @completed_bytes: Bytes transferred by completed transactions
+ * @errors: Error interrupts
+ * @replayed: Transactions restarted after a device reset
+ * @hw_time_hist: Histogram of start to completion interrupt times
+ * @callback_time_hist: Histogram of completion interrupt to callback times
+ *
+ * Counters are only ever incremented on the local CPU and summed when read
+ * through debugfs, so keeping them enabled costs no shared cache lines.
+ */
+struct xilinx_dma_chan_stats {
+	u64 irqs;
+	u64 spurious_irqs;
+	u64 completed;
+	u64 completed_bytes;
+	u64 errors;
+	u64 replayed;
+	u64 hw_time_hist[XILINX_DMA_STATS_HIST_BUCKETS];
+	u64 callback_time_hist[XILINX_DMA_STATS_HIST_BUCKETS];
 };
 
 enum xilinx_dma_chan_status {
@@ -102,10 +177,23 @@ enum xilinx_dma_chan_status {
  * @dev: The dma device
  * @lock: Descriptor operation lock
  * @status: Channel status
+ * @running: Channel has been started (DMACR.RS set and DMASR.Halted clear)
+ * @cyclic: A cyclic transaction is pending or active, nothing else can be
+ *          submitted until the channel is terminated
+ * @paused: No new transaction (or cyclic period) is started until resumed
+ * @resetting: Like @paused, but owned by the error recovery
  * @pending_transactions: Transactions waiting
  * @active_transaction: Currently active transaction
  * @completed_transactions: Transactions completed
+ * @free_descriptors: Descriptors recycled for reuse by the prep functions
  * @tasklet: Cleanup work after irq / completed transaction cleanup.
+ * @completion_task: Completion thread, used instead of @tasklet if not NULL
+ * @completion_pending: Bit 0 is set when @completion_task has work to do
+ * @pending_count: Number of transactions in pending_transactions
+ * @completed_count: Number of transactions in completed_transactions
+ * @stats: Per-CPU statistics
+ * @last_error_status: DMASR value of the last error interrupt
+ * @debugfs: Channel debugfs directory
 
  * @ctrl_offset: Control registers offset
  * @id: Channel ID
@@ -113,6 +201,7 @@ enum xilinx_dma_chan_status {
  * @name: String name
  * @direction: Channel direction
  * @max_transaction_length: Maximum transaction length
+ * @width: Stream data width in bytes
  */
 struct xilinx_dma_chan {
 	struct dma_chan          common;
@@ -122,12 +211,26 @@ struct xilinx_dma_chan {
 	spinlock_t lock;
 
 	enum xilinx_dma_chan_status       status;
+	bool                              running;
+	bool                              cyclic;
+	bool                              paused;
+	bool                              resetting;
 
 	struct list_head                  pending_transactions;
 	struct xilinx_dma_tx_descriptor  *active_transaction;
 	struct list_head                  completed_transactions;
+	struct list_head                  free_descriptors;
 
 	struct tasklet_struct             tasklet;
+	struct task_struct               *completion_task;
+	unsigned long                     completion_pending;
+
+	/* Statistics */
+	u32                               pending_count;
+	u32                               completed_count;
+	struct xilinx_dma_chan_stats __percpu *stats;
+	u32                               last_error_status;
+	struct dentry                    *debugfs;
 
 	/* Constant values after initialization. */
 	u32 ctrl_offset;
@@ -137,6 +240,7 @@ struct xilinx_dma_chan {
 	enum dma_transfer_direction direction;
 	u32 max_transaction_length;
 	u32 peri_id;
+	u32 width;
 };
 
 /**
@@ -145,6 +249,10 @@ struct xilinx_dma_chan {
  * @dev: Device Structure
  * @common: DMA device structure
  * @chan: Driver specific DMA channel
+ * @debugfs: Device debugfs directory
+ * @recover_work: Error recovery, resets the core and replays both channels
+ * @reset_failed: Error recovery could not reset the core
+ * @ext_addr: Core is configured for more than 32 address bits
  */
 struct xilinx_dma_device {
 	void __iomem *regs;
@@ -153,6 +261,10 @@ struct xilinx_dma_device {
 	struct xilinx_dma_chan *chan[XILINX_DMA_MAX_CHANS_PER_DEVICE];
 	u32 nr_channels;
 	u32 chan_id;
+	struct dentry *debugfs;
+	struct work_struct recover_work;
+	bool reset_failed;
+	bool ext_addr;
 };
 
 /* Macros */
@@ -161,6 +273,10 @@ struct xilinx_dma_device {
 #define to_xilinx_tx_descriptor(tx) \
 	container_of(tx, struct xilinx_dma_tx_descriptor, async_tx)
 
+/* Tracepoints */
+#define CREATE_TRACE_POINTS
+#include "xilinx_dma_dr_trace.h"
+
 /* IO accessors
  *
  * Accessors for the registers of each channel using the base address of the
@@ -195,21 +311,19 @@ static inline void dma_ctrl_writeq(struct xilinx_dma_chan *chan, u32 reg,
 }
 #endif
 
-/* Automatically choose the correct of either write or writeq depending on dma_addr_t
- * or more specifically on the define that defines dma_addr_t as either u32 or u64.
- *
- * Note: we're actually using the define for phys_addr_t, which raises the question
- * should we be using phys_addr_t?
- * Purpose: to cut down on the number of ifdefs required in this driver!
+/* Write a DMA address to an address register and, when the core has more
+ * than 32 address bits, its MSB register which follows it (eg SRCDSTADDR and
+ * SRCDSTADDRMSB).
  */
 static inline void dma_ctrl_write_addr(struct xilinx_dma_chan *chan, u32 reg,
 	                               dma_addr_t value)
 {
-#ifdef CONFIG_PHYS_ADDR_T_64BIT
-	dma_ctrl_writeq(chan, reg, value);
-#else
-	dma_ctrl_write(chan, reg, value);
-#endif
+	/* The registers are 32-bit AXI4-Lite, so write the MSB register
+	 * separately rather than relying on writeq() being split.
+	 */
+	dma_ctrl_write(chan, reg, lower_32_bits(value));
+	if (chan->xdev->ext_addr)
+		dma_ctrl_write(chan, reg + 4, upper_32_bits(value));
 }
 
 static inline void dma_ctrl_clear(struct xilinx_dma_chan *chan, u32 reg, u32 clear)
@@ -222,6 +336,83 @@ static inline void dma_ctrl_set(struct xilinx_dma_chan *chan, u32 reg, u32 set)
 	dma_ctrl_write(chan, reg, dma_ctrl_read(chan, reg) | set);
 }
 
+/* Statistics
+ *
+ * Histogram bucket 0 counts times below 1 us, bucket N counts times in
+ * [2^(N-1), 2^N) us, and the last bucket counts everything above.
+ */
+static inline unsigned int xilinx_dma_stats_bucket(ktime_t from, ktime_t to)
+{
+	s64 us = ktime_us_delta(to, from);
+
+	if (us <= 0)
+		return 0;
+
+	return min_t(unsigned int, fls64(us), XILINX_DMA_STATS_HIST_BUCKETS - 1);
+}
+
+static int xilinx_dma_stats_show(struct seq_file *s, void *data)
+{
+	struct xilinx_dma_chan *chan = s->private;
+	struct xilinx_dma_chan_stats sum = {0};
+	unsigned long flags;
+	u32 pending_count;
+	int cpu, i;
+
+	for_each_possible_cpu(cpu) {
+		struct xilinx_dma_chan_stats *st = per_cpu_ptr(chan->stats, cpu);
+
+		sum.irqs += st->irqs;
+		sum.spurious_irqs += st->spurious_irqs;
+		sum.completed += st->completed;
+		sum.completed_bytes += st->completed_bytes;
+		sum.errors += st->errors;
+		sum.replayed += st->replayed;
+		for (i = 0; i < XILINX_DMA_STATS_HIST_BUCKETS; i++) {
+			sum.hw_time_hist[i] += st->hw_time_hist[i];
+			sum.callback_time_hist[i] += st->callback_time_hist[i];
+		}
+	}
+
+	spin_lock_irqsave(&chan->lock, flags);
+	pending_count = chan->pending_count;
+	spin_unlock_irqrestore(&chan->lock, flags);
+
+	seq_printf(s, "irqs:              %llu\n", sum.irqs);
+	seq_printf(s, "spurious_irqs:     %llu\n", sum.spurious_irqs);
+	seq_printf(s, "completed:         %llu\n", sum.completed);
+	seq_printf(s, "completed_bytes:   %llu\n", sum.completed_bytes);
+	seq_printf(s, "errors:            %llu\n", sum.errors);
+	seq_printf(s, "replayed:          %llu\n", sum.replayed);
+	seq_printf(s, "last_error_status: 0x%08x\n", chan->last_error_status);
+	seq_printf(s, "pending:           %u\n", pending_count);
+
+	seq_puts(s, "\n<= us      hw_time    callback_time\n");
+	for (i = 0; i < XILINX_DMA_STATS_HIST_BUCKETS; i++) {
+		if (i == XILINX_DMA_STATS_HIST_BUCKETS - 1)
+			seq_puts(s, "inf    ");
+		else
+			seq_printf(s, "%-7lu", 1UL << i);
+		seq_printf(s, " %10llu %16llu\n", sum.hw_time_hist[i],
+			   sum.callback_time_hist[i]);
+	}
+
+	return 0;
+}
+
+static int xilinx_dma_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, xilinx_dma_stats_show, inode->i_private);
+}
+
+static const struct file_operations xilinx_dma_stats_fops = {
+	.owner   = THIS_MODULE,
+	.open    = xilinx_dma_stats_open,
+	.read    = seq_read,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
+
 
 /**
  * xilinx_dma_tx_descriptor - Allocate transaction descriptor
@@ -233,11 +424,26 @@ static struct xilinx_dma_tx_descriptor *
 xilinx_dma_alloc_tx_descriptor(struct xilinx_dma_chan *chan)
 {
 	struct xilinx_dma_tx_descriptor *desc;
+	unsigned long flags;
+
+	/* Reuse a recycled descriptor if there is one. */
+	spin_lock_irqsave(&chan->lock, flags);
+	desc = list_first_entry_or_null(&chan->free_descriptors,
+					struct xilinx_dma_tx_descriptor, node);
+	if (desc)
+		list_del(&desc->node);
+	spin_unlock_irqrestore(&chan->lock, flags);
+
+	if (desc) {
+		memset(desc, 0, sizeof(*desc));
+		return desc;
+	}
 
 	/* Allocate memory using devm_kzalloc() which guarentees to free
-	 * automatically when the driver exits.
+	 * automatically when the driver exits.  The prep functions may be
+	 * called from a completion callback, so this must not sleep.
 	 */
-	desc = devm_kzalloc(chan->dev, sizeof(*desc), GFP_KERNEL);
+	desc = devm_kzalloc(chan->dev, sizeof(*desc), GFP_NOWAIT);
 
 	if (!desc)
 		return NULL;
@@ -315,6 +521,10 @@ static void xilinx_dma_free_descriptors(struct xilinx_dma_chan *chan)
 	xilinx_dma_free_desc_list(chan, &chan->completed_transactions);
 	xilinx_dma_free_tx_descriptor(chan, chan->active_transaction);
 	chan->active_transaction = NULL;
+	chan->pending_count = 0;
+	chan->completed_count = 0;
+	chan->cyclic = false;
+	chan->paused = false;
 
 	spin_unlock_irqrestore(&chan->lock, flags);
 }
@@ -326,8 +536,13 @@ static void xilinx_dma_free_descriptors(struct xilinx_dma_chan *chan)
 static void xilinx_dma_free_chan_resources(struct dma_chan *dchan)
 {
 	struct xilinx_dma_chan *chan = to_xilinx_chan(dchan);
+	unsigned long flags;
 
 	xilinx_dma_free_descriptors(chan);
+
+	spin_lock_irqsave(&chan->lock, flags);
+	xilinx_dma_free_desc_list(chan, &chan->free_descriptors);
+	spin_unlock_irqrestore(&chan->lock, flags);
 }
 
 /**
@@ -347,27 +562,38 @@ static enum dma_status xilinx_dma_tx_status(struct dma_chan *dchan,
 	enum dma_status ret;
 	unsigned long flags;
 	u32 residue = -1;
+	bool error = false;
 
 	/* Check if asking for the active transaction. */
 	spin_lock_irqsave(&chan->lock, flags);
 	at = chan->active_transaction;
 	if (at && at->async_tx.cookie == cookie) {
 
-		/* Active transaction!  Lets get it from register with IRQ disabled. */
-		residue = at->requested_length - dma_ctrl_read(chan, XILINX_DMA_REG_BTT);
+		if (at->cyclic) {
+			/* Residue of a cyclic transaction is what is left of the
+			 * ring from the start of the period being transferred,
+			 * so the position is requested_length - residue.
+			 */
+			residue = at->requested_length - at->period * at->period_len;
+		} else {
+			/* Active transaction!  Lets get it from register with IRQ disabled. */
+			residue = at->requested_length - dma_ctrl_read(chan, XILINX_DMA_REG_BTT);
+		}
+
+		ret = (at->cyclic && at->stalled) ? DMA_PAUSED : DMA_IN_PROGRESS;
 
 		dma_cookie_status(dchan, cookie, txstate);
 		dma_set_residue(txstate, residue);
 		spin_unlock_irqrestore(&chan->lock, flags);
-		return DMA_IN_PROGRESS;
+		return ret;
 	}
-	spin_unlock_irqrestore(&chan->lock, flags);
-
 
 	/* Not an active transaction. */
 
 	/* Check every completed transaction for this cookie, and
-	 * update the residue if found.
+	 * update the residue if found.  The history is trimmed by the
+	 * completion cleanup and emptied by terminate_all(), so it is walked
+	 * under the lock.
 	 *
 	 * note: check in reverse order because newest entries are
 	 *       at the tail, and its likely the newest is being asked for.
@@ -376,9 +602,11 @@ static enum dma_status xilinx_dma_tx_status(struct dma_chan *dchan,
 		if (transaction->async_tx.cookie == cookie) {
 			residue = (transaction->requested_length
 				   - transaction->transferred_length);
+			error = transaction->error;
 			break;
 		}
 	}
+	spin_unlock_irqrestore(&chan->lock, flags);
 
 	/* Get the transaction status based on the cookie value, vs the
 	 * completed_cookie value in the channel structure.
@@ -387,6 +615,13 @@ static enum dma_status xilinx_dma_tx_status(struct dma_chan *dchan,
 	 */
 	ret = dma_cookie_status(dchan, cookie, txstate);
 
+	/* Pending transactions of a paused channel are not going to start. */
+	if (ret == DMA_IN_PROGRESS && chan->paused)
+		ret = DMA_PAUSED;
+
+	if (ret == DMA_COMPLETE && error)
+		ret = DMA_ERROR;
+
 	/* Update the proper residue.  This will be either -1 if not found,
 	 * or the value from the completed transactions.
 	 */
@@ -425,6 +660,7 @@ static void xilinx_dma_hw_halt(struct xilinx_dma_chan *chan)
 			chan->name, dma_ctrl_read(chan, XILINX_DMA_REG_STATUS));
 	}
 
+	chan->running = false;
 	chan->status = CHAN_IDLE;
 }
 
@@ -449,9 +685,11 @@ static void xilinx_dma_hw_start(struct xilinx_dma_chan *chan)
 		dev_err(chan->dev, "Cannot start channel %s (%p) : SR = %x\n",
 			chan->name, chan, dma_ctrl_read(chan, XILINX_DMA_REG_STATUS));
 		chan->status = CHAN_ERROR;
+		schedule_work(&chan->xdev->recover_work);
 		return;
 	}
 
+	chan->running = true;
 	chan->status = CHAN_IDLE;
 }
 
@@ -463,9 +701,10 @@ static void xilinx_dma_start_transfer_irq(struct xilinx_dma_chan *chan)
 {
 	struct xilinx_dma_tx_descriptor *transaction;
 
-	if (chan->status != CHAN_IDLE || list_empty(&chan->pending_transactions)) {
-		/* No need to start the channel if it isn't IDLE or there are
-		 * no pending transactions.
+	if (chan->status != CHAN_IDLE || chan->paused || chan->resetting ||
+	    list_empty(&chan->pending_transactions)) {
+		/* No need to start the channel if it isn't IDLE, is paused or
+		 * being reset, or there are no pending transactions.
 		 */
 		return;
 	}
@@ -478,23 +717,42 @@ static void xilinx_dma_start_transfer_irq(struct xilinx_dma_chan *chan)
 	/* Get the next transaction. */
 	transaction = list_first_entry(&chan->pending_transactions, struct xilinx_dma_tx_descriptor, node);
 
+	/* Cyclic transactions start with the first period of the ring. */
+	if (transaction->cyclic) {
+		transaction->period = 0;
+		transaction->periods_elapsed = 0;
+	}
+
 	/* Assign the transactions source/destination memory address to the Xilinx DMA hardware. */
 	dma_ctrl_write_addr(chan, XILINX_DMA_REG_SRCDSTADDR, transaction->async_tx.phys);
 
-	/* Enable the DMA hardware if it is not already started. */
-	xilinx_dma_hw_start(chan);
+	/* Enable the DMA hardware if it is not already started.  The channel
+	 * stays running between transactions, so once started only SRCDSTADDR
+	 * and BTT are written per transaction, without the DMACR read-modify-write
+	 * and the DMASR poll.
+	 */
+	if (unlikely(!chan->running)) {
+		xilinx_dma_hw_start(chan);
 
-	if (chan->status != CHAN_IDLE) {
-		return;
+		if (chan->status != CHAN_IDLE) {
+			return;
+		}
 	}
 
 	/* Remove the transaction from the pending list. */
 	list_del(&transaction->node);
+	chan->pending_count--;
 
 	/* Start the transfer */
 	chan->status = CHAN_BUSY;
 	chan->active_transaction = transaction;
-	dma_ctrl_write(chan, XILINX_DMA_REG_BTT, transaction->requested_length);
+	transaction->start_time = ktime_get();
+	dma_ctrl_write(chan, XILINX_DMA_REG_BTT,
+		       transaction->cyclic ? transaction->period_len
+					   : transaction->requested_length);
+
+	trace_xilinx_dma_dr_start_transfer(chan->name, transaction->async_tx.cookie,
+					   transaction->requested_length, 0);
 }
 
 /**
@@ -518,20 +776,52 @@ static void xilinx_dma_chan_tx_completed_cleanup(struct xilinx_dma_chan *chan)
 {
 	struct xilinx_dma_tx_descriptor *desc, *next;
 	unsigned long flags;
-	unsigned long count = 0;
 
 	spin_lock_irqsave(&chan->lock, flags);
 
-	/* Run any callbacks which have not been executed, and count the number
-	 * of completed transactions.
+	/* Run the callback of an active cyclic transaction once for every
+	 * period that elapsed since the tasklet last ran.  The transaction
+	 * may be terminated while the lock is dropped, so look it up again
+	 * every time.
 	 */
-	list_for_each_entry_safe(desc, next, &chan->completed_transactions, node) {
+	desc = chan->active_transaction;
+	while (desc && desc->cyclic && desc->periods_elapsed &&
+	       (desc->async_tx.flags & DMA_PREP_INTERRUPT)) {
+		dma_async_tx_callback callback = desc->async_tx.callback;
+		void *callback_param = desc->async_tx.callback_param;
+
+		desc->periods_elapsed--;
 
-		count++;
+		if (callback) {
+			trace_xilinx_dma_dr_callback(chan->name, desc->async_tx.cookie,
+						     desc->period_len,
+						     desc->transferred_length);
+			this_cpu_inc(chan->stats->callback_time_hist[
+				xilinx_dma_stats_bucket(desc->irq_time, ktime_get())]);
 
-		if (desc->async_tx.callback) {
+			spin_unlock_irqrestore(&chan->lock, flags);
+			callback(callback_param);
+			spin_lock_irqsave(&chan->lock, flags);
+		}
+
+		desc = chan->active_transaction;
+	}
+
+	/* Run any callbacks which have not been executed.  The client asked
+	 * for no callback by leaving out DMA_PREP_INTERRUPT.
+	 */
+	list_for_each_entry_safe(desc, next, &chan->completed_transactions, node) {
+
+		if (desc->async_tx.callback &&
+		    (desc->async_tx.flags & DMA_PREP_INTERRUPT)) {
 			dma_async_tx_callback callback = desc->async_tx.callback;
 
+			trace_xilinx_dma_dr_callback(chan->name, desc->async_tx.cookie,
+						     desc->requested_length,
+						     desc->transferred_length);
+			this_cpu_inc(chan->stats->callback_time_hist[
+				xilinx_dma_stats_bucket(desc->irq_time, ktime_get())]);
+
 			spin_unlock_irqrestore(&chan->lock, flags);
 			callback(desc->async_tx.callback_param);
 			spin_lock_irqsave(&chan->lock, flags);
@@ -540,45 +830,62 @@ static void xilinx_dma_chan_tx_completed_cleanup(struct xilinx_dma_chan *chan)
 		}
 	}
 
-	/* Finalize and free any completed transactions above some number that are kept
-	 * for dma_status calls.
+	/* Finalize and recycle any completed transactions above some number that
+	 * are kept for dma_status calls.
 	 */
-	while (count > XILINX_DMA_TX_HISTORY) {
+	while (chan->completed_count > XILINX_DMA_TX_HISTORY) {
 
 		/* Get the first descriptor. */
 		desc = list_first_entry(&chan->completed_transactions,
 				struct xilinx_dma_tx_descriptor, node);
 
-		/* Remove from the list of completed transactions. */
-		list_del(&desc->node);
-
-		/* Run any dependencies, then free the descriptor. */
+		/* Run any dependencies, then recycle the descriptor. */
 		dma_run_dependencies(&desc->async_tx);
-		xilinx_dma_free_tx_descriptor(chan, desc);
+		list_move(&desc->node, &chan->free_descriptors);
 
 		/* Decrement the number of transactions. */
-		count--;
+		chan->completed_count--;
 
 	}
 
 	spin_unlock_irqrestore(&chan->lock, flags);
 }
 
+/**
+ * xilinx_dma_schedule_completion - Schedule completion processing
+ * @chan: Driver specific DMA channel
+ *
+ * Context: Any
+ */
+static void xilinx_dma_schedule_completion(struct xilinx_dma_chan *chan)
+{
+	if (chan->completion_task) {
+		set_bit(0, &chan->completion_pending);
+		wake_up_process(chan->completion_task);
+	} else {
+		tasklet_schedule(&chan->tasklet);
+	}
+}
+
 /**
  * xilinx_dma_complete_active_irq - Mark the active descriptor as complete
  * @chan : xilinx DMA channel
  *
  * Context: IRQ Handler
+ *
+ * Return: true if the tasklet needs to run, for a callback or to trim the
+ *         completed transactions history
  */
-static void xilinx_dma_complete_active_irq(struct xilinx_dma_chan *chan)
+static bool xilinx_dma_complete_active_irq(struct xilinx_dma_chan *chan)
 {
 	dma_cookie_t save_cookie;
 	struct xilinx_dma_tx_descriptor *transaction;
+	unsigned long flags;
 
 	transaction = chan->active_transaction;
 
 	if (transaction == NULL) {
-		return;
+		return false;
 	}
 
 	/* Update the transfered length in the context if it was provided. */
@@ -599,12 +906,117 @@ static void xilinx_dma_complete_active_irq(struct xilinx_dma_chan *chan)
 	dma_cookie_complete(&transaction->async_tx);
 	transaction->async_tx.cookie = save_cookie;
 
-	/* Add the completed transaction to the completed_transactions list. */
-	list_add_tail(&transaction->node, &chan->completed_transactions);
+	this_cpu_inc(chan->stats->completed);
+	this_cpu_add(chan->stats->completed_bytes, transaction->transferred_length);
+
+	trace_xilinx_dma_dr_complete(chan->name, save_cookie,
+				     transaction->requested_length,
+				     transaction->transferred_length);
 
 	/* Change channel status to IDLE. */
 	chan->status = CHAN_IDLE;
 
+	/* Nobody waits on a transaction prepped with DMA_CTRL_ACK and without
+	 * DMA_PREP_INTERRUPT, so if it has no residue to report either, its
+	 * descriptor is recycled right away instead of going to the history.
+	 */
+	flags = transaction->async_tx.flags;
+	if (!(flags & DMA_PREP_INTERRUPT) && (flags & DMA_CTRL_ACK) &&
+	    !transaction->error &&
+	    transaction->transferred_length == transaction->requested_length) {
+		list_add(&transaction->node, &chan->free_descriptors);
+		return false;
+	}
+
+	/* Add the completed transaction to the completed_transactions list. */
+	list_add_tail(&transaction->node, &chan->completed_transactions);
+	chan->completed_count++;
+
+	/* Without a callback to run the tasklet is only needed to trim the
+	 * history, which is left to grow to twice its size so that happens
+	 * once for every XILINX_DMA_TX_HISTORY transactions.
+	 */
+	if (!(flags & DMA_PREP_INTERRUPT))
+		return chan->completed_count >= 2 * XILINX_DMA_TX_HISTORY;
+
+	return true;
+}
+
+/**
+ * xilinx_dma_cyclic_start_period - Start the current period of a cyclic transaction
+ * @chan : xilinx DMA channel
+ * @at : Active cyclic transaction
+ *
+ * Context: channel lock held
+ */
+static void xilinx_dma_cyclic_start_period(struct xilinx_dma_chan *chan,
+					   struct xilinx_dma_tx_descriptor *at)
+{
+	at->stalled = false;
+
+	dma_ctrl_write_addr(chan, XILINX_DMA_REG_SRCDSTADDR,
+			    at->async_tx.phys + at->period * at->period_len);
+
+	/* Only after an error recovery reset the channel is not running. */
+	if (unlikely(!chan->running)) {
+		xilinx_dma_hw_start(chan);
+
+		if (chan->status != CHAN_IDLE) {
+			at->stalled = true;
+			return;
+		}
+		chan->status = CHAN_BUSY;
+	}
+
+	at->start_time = ktime_get();
+	dma_ctrl_write(chan, XILINX_DMA_REG_BTT, at->period_len);
+
+	trace_xilinx_dma_dr_start_transfer(chan->name, at->async_tx.cookie,
+					   at->period_len, 0);
+}
+
+/**
+ * xilinx_dma_cyclic_period_irq - Complete a period and re-arm the next one
+ * @chan : xilinx DMA channel
+ *
+ * The active cyclic transaction never completes, the next period of the ring
+ * is started right here by writing SRCDSTADDR and BTT, so the ring keeps
+ * running without any descriptor allocation or help from the tasklet.  The
+ * tasklet only runs the per-period callbacks.
+ *
+ * Context: IRQ Handler, channel lock held
+ *
+ * Return: true if the tasklet needs to run the period callback
+ */
+static bool xilinx_dma_cyclic_period_irq(struct xilinx_dma_chan *chan)
+{
+	struct xilinx_dma_tx_descriptor *at = chan->active_transaction;
+	bool interrupt;
+
+	this_cpu_inc(chan->stats->completed);
+	this_cpu_add(chan->stats->completed_bytes, at->transferred_length);
+
+	trace_xilinx_dma_dr_complete(chan->name, at->async_tx.cookie,
+				     at->period_len, at->transferred_length);
+
+	interrupt = at->async_tx.flags & DMA_PREP_INTERRUPT;
+	if (interrupt)
+		at->periods_elapsed++;
+
+	/* Move to the next period of the ring and start it, unless paused
+	 * in which case xilinx_dma_resume() starts it.
+	 */
+	if (++at->period == at->num_periods)
+		at->period = 0;
+
+	if (unlikely(chan->paused || chan->resetting)) {
+		at->stalled = true;
+		return interrupt;
+	}
+
+	xilinx_dma_cyclic_start_period(chan, at);
+
+	return interrupt;
 }
 
 /**
@@ -633,11 +1045,169 @@ static int xilinx_dma_hw_reset(struct xilinx_dma_chan *chan)
 		return -EBUSY;
 	}
 
+	/* Reset clears DMACR.RS, so the channel must be started again. */
+	chan->running = false;
 	chan->status = CHAN_IDLE;
 
 	return err;
 }
 
+/**
+ * xilinx_dma_recover_hold - Stop a channel from starting anything new
+ * @chan: Driver specific DMA channel
+ */
+static void xilinx_dma_recover_hold(struct xilinx_dma_chan *chan)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&chan->lock, flags);
+	chan->resetting = true;
+	spin_unlock_irqrestore(&chan->lock, flags);
+}
+
+/**
+ * xilinx_dma_recover_save - Save the active transaction of a channel for replay
+ * @chan: Driver specific DMA channel
+ *
+ * A transaction the hardware finished before the reset is completed here,
+ * anything else that is still active goes back to the head of the pending
+ * queue, or for a cyclic transaction, restarts at the current period.
+ *
+ * Return: DMACR of the channel, without the run and reset bits
+ */
+static u32 xilinx_dma_recover_save(struct xilinx_dma_chan *chan)
+{
+	struct xilinx_dma_tx_descriptor *at;
+	unsigned long flags;
+	u32 status, dmacr;
+
+	spin_lock_irqsave(&chan->lock, flags);
+
+	dmacr = dma_ctrl_read(chan, XILINX_DMA_REG_CONTROL);
+	status = dma_ctrl_read(chan, XILINX_DMA_REG_STATUS);
+	at = chan->active_transaction;
+
+	if (at && !at->cyclic && (status & XILINX_DMA_XR_IRQ_IOC_MASK)) {
+		dma_ctrl_write(chan, XILINX_DMA_REG_STATUS,
+			       XILINX_DMA_XR_IRQ_IOC_MASK);
+		at->transferred_length = dma_ctrl_read(chan, XILINX_DMA_REG_BTT);
+		at->irq_time = ktime_get();
+		if (xilinx_dma_complete_active_irq(chan))
+			xilinx_dma_schedule_completion(chan);
+	} else if (at && !at->cyclic) {
+		list_add(&at->node, &chan->pending_transactions);
+		chan->pending_count++;
+		chan->active_transaction = NULL;
+		this_cpu_inc(chan->stats->replayed);
+	} else if (at) {
+		at->stalled = true;
+		this_cpu_inc(chan->stats->replayed);
+	}
+
+	spin_unlock_irqrestore(&chan->lock, flags);
+
+	return dmacr & ~(XILINX_DMA_CR_RUNSTOP_MASK | XILINX_DMA_CR_RESET_MASK);
+}
+
+/**
+ * xilinx_dma_recover_restart - Restart a channel after the reset
+ * @chan: Driver specific DMA channel
+ * @dmacr: DMACR saved by xilinx_dma_recover_save()
+ * @err: Result of the reset
+ */
+static void xilinx_dma_recover_restart(struct xilinx_dma_chan *chan, u32 dmacr,
+				       int err)
+{
+	struct xilinx_dma_tx_descriptor *at;
+	unsigned long flags;
+
+	spin_lock_irqsave(&chan->lock, flags);
+
+	chan->resetting = false;
+	chan->running = false;
+
+	if (err) {
+		chan->status = CHAN_ERROR;
+		spin_unlock_irqrestore(&chan->lock, flags);
+		return;
+	}
+
+	/* Reset clears the interrupt enables as well. */
+	dma_ctrl_write(chan, XILINX_DMA_REG_CONTROL, dmacr);
+	chan->status = CHAN_IDLE;
+
+	at = chan->active_transaction;
+	if (at && at->cyclic) {
+		chan->status = CHAN_BUSY;
+		if (!chan->paused)
+			xilinx_dma_cyclic_start_period(chan, at);
+	} else {
+		xilinx_dma_start_transfer_irq(chan);
+	}
+
+	spin_unlock_irqrestore(&chan->lock, flags);
+}
+
+/**
+ * xilinx_dma_recover_work - Recover the DMA core from a channel error
+ * @work: recover_work of the Xilinx DMA device
+ *
+ * A DMA error halts the failing channel, and the only way to get it going
+ * again is a reset of the core, which resets both MM2S and S2MM.  So the
+ * healthy channel is held (nothing new is started on it), given
+ * XILINX_DMA_RECOVER_DRAIN_US to finish its active transfer, and whatever it
+ * could not finish is replayed from the start after the reset together with
+ * both pending queues.  Note a replayed MM2S transfer was cut short by the
+ * reset, so the stream sees a truncated packet followed by the full one.
+ *
+ * Context: Process, the reset polls with sleeps
+ */
+static void xilinx_dma_recover_work(struct work_struct *work)
+{
+	struct xilinx_dma_device *xdev =
+		container_of(work, struct xilinx_dma_device, recover_work);
+	u32 dmacr[XILINX_DMA_MAX_CHANS_PER_DEVICE];
+	struct xilinx_dma_chan *chan, *reset_chan = NULL;
+	int i, err;
+	u32 val;
+
+	for (i = 0; i < xdev->nr_channels; i++)
+		if (xdev->chan[i])
+			xilinx_dma_recover_hold(xdev->chan[i]);
+
+	for (i = 0; i < xdev->nr_channels; i++) {
+		chan = xdev->chan[i];
+		if (!chan)
+			continue;
+
+		/* The failing channel is halted, a healthy one goes idle at
+		 * the end of its active transfer (or cyclic period).
+		 */
+		xilinx_dma_poll_timeout(chan, XILINX_DMA_REG_STATUS, val,
+					val & (XILINX_DMA_SR_HALTED_MASK |
+					       XILINX_DMA_SR_IDLE_MASK),
+					10, XILINX_DMA_RECOVER_DRAIN_US);
+
+		dmacr[i] = xilinx_dma_recover_save(chan);
+		reset_chan = chan;
+	}
+
+	if (!reset_chan)
+		return;
+
+	dev_warn(xdev->dev, "Resetting DMA core after a channel error.\n");
+
+	err = xilinx_dma_hw_reset(reset_chan);
+	if (err) {
+		dev_err(xdev->dev, "Reset failed.  Driver in-operable.\n");
+		xdev->reset_failed = true;
+	}
+
+	for (i = 0; i < xdev->nr_channels; i++)
+		if (xdev->chan[i])
+			xilinx_dma_recover_restart(xdev->chan[i], dmacr[i], err);
+}
+
 /**
  * xilinx_dma_irq_handler - DMA Interrupt handler
  * @irq: IRQ number
@@ -648,6 +1218,8 @@ static int xilinx_dma_hw_reset(struct xilinx_dma_chan *chan)
 static irqreturn_t xilinx_dma_irq_handler(int irq, void *data)
 {
 	struct xilinx_dma_chan *chan = data;
+	struct xilinx_dma_tx_descriptor *at;
+	bool schedule = false;
 	u32 status;
 
 	/* Read the status and ack the interrupts. */
@@ -656,6 +1228,19 @@ static irqreturn_t xilinx_dma_irq_handler(int irq, void *data)
 		return IRQ_NONE;
 	}
 
+	this_cpu_inc(chan->stats->irqs);
+
+	/* The active transaction is only read and updated under the lock, it
+	 * may be completed and freed by terminate_all() on another CPU.
+	 */
+	spin_lock(&chan->lock);
+
+	at = chan->active_transaction;
+	trace_xilinx_dma_dr_irq(chan->name, status,
+				at ? at->async_tx.cookie : 0,
+				at ? at->requested_length : 0,
+				at ? at->transferred_length : 0);
+
 	dma_ctrl_write(chan, XILINX_DMA_REG_STATUS,
 		       status & XILINX_DMA_XR_IRQ_ALL_MASK);
 
@@ -665,15 +1250,35 @@ static irqreturn_t xilinx_dma_irq_handler(int irq, void *data)
 			chan->name, chan,
 			dma_ctrl_read(chan, XILINX_DMA_REG_CONTROL),
 			dma_ctrl_read(chan, XILINX_DMA_REG_STATUS));
+		this_cpu_inc(chan->stats->errors);
+		chan->last_error_status = status;
+
+		/* The hardware halts itself on an error. */
+		chan->running = false;
+
+		/* Fail the transaction that hit the error, the client finds out
+		 * through DMA_ERROR from tx_status().  A cyclic transaction is
+		 * restarted at the current period by the recovery instead.
+		 */
+		if (at && !at->cyclic) {
+			at->error = true;
+			at->transferred_length = 0;
+			at->irq_time = ktime_get();
+			schedule = xilinx_dma_complete_active_irq(chan);
+		}
 		chan->status = CHAN_ERROR;
+
+		spin_unlock(&chan->lock);
+
+		schedule_work(&chan->xdev->recover_work);
+		if (schedule)
+			xilinx_dma_schedule_completion(chan);
 		return IRQ_HANDLED;
 	}
 
 	/* Check if Interrupt on Complete (IOC) has occured.
 	 */
 	if (status & XILINX_DMA_XR_IRQ_IOC_MASK) {
-		struct xilinx_dma_tx_descriptor *at = chan->active_transaction;
-
 		/* Check that there is an active transaction. */
 		if (!at) {
 			/* This is caused by the way terminate_all() is implemented
@@ -697,19 +1302,32 @@ static irqreturn_t xilinx_dma_irq_handler(int irq, void *data)
 			 */
 			dev_err(chan->dev, "Channel %s fired interrupt without "
 				"an active transaction!\n", chan->name);
+			this_cpu_inc(chan->stats->spurious_irqs);
+			spin_unlock(&chan->lock);
 			return IRQ_HANDLED;
 		}
 
 		/* Update the transferred number of bytes. */
 		at->transferred_length = dma_ctrl_read(chan, XILINX_DMA_REG_BTT);
-
-		spin_lock(&chan->lock);
-		xilinx_dma_complete_active_irq(chan);
-		xilinx_dma_start_transfer_irq(chan);
-		spin_unlock(&chan->lock);
+		at->irq_time = ktime_get();
+		this_cpu_inc(chan->stats->hw_time_hist[
+			xilinx_dma_stats_bucket(at->start_time, at->irq_time)]);
+
+		if (at->cyclic) {
+			schedule = xilinx_dma_cyclic_period_irq(chan);
+		} else {
+			schedule = xilinx_dma_complete_active_irq(chan);
+			xilinx_dma_start_transfer_irq(chan);
+		}
 	}
 
-	tasklet_schedule(&chan->tasklet);
+	spin_unlock(&chan->lock);
+
+	/* The tasklet is skipped entirely for transactions without
+	 * DMA_PREP_INTERRUPT.
+	 */
+	if (schedule)
+		xilinx_dma_schedule_completion(chan);
 	return IRQ_HANDLED;
 }
 
@@ -724,6 +1342,102 @@ static void xilinx_dma_do_tasklet(unsigned long data)
 	xilinx_dma_chan_tx_completed_cleanup(chan);
 }
 
+/**
+ * xilinx_dma_completion_thread - Completion thread of a channel
+ * @data: Pointer to the Xilinx dma channel structure
+ *
+ * Return: '0' always
+ */
+static int xilinx_dma_completion_thread(void *data)
+{
+	struct xilinx_dma_chan *chan = data;
+
+	/* The state is set before the checks, so a kthread_stop() or a
+	 * completion between them makes schedule() return at once.
+	 */
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (kthread_should_stop())
+			break;
+		if (!test_and_clear_bit(0, &chan->completion_pending)) {
+			schedule();
+			continue;
+		}
+		__set_current_state(TASK_RUNNING);
+
+		xilinx_dma_chan_tx_completed_cleanup(chan);
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return 0;
+}
+
+/**
+ * xilinx_dma_completion_thread_start - Start the completion thread of a channel
+ * @chan: Driver specific DMA channel
+ * @node: Channel device node
+ *
+ * Completions run in a tasklet on the CPU that took the interrupt, unless
+ * the completion_thread parameter is set or the channel node has a
+ * xlnx,completion-cpu or xlnx,completion-priority property.  Then they run
+ * in a kernel thread of the channel, on the given CPU and with the given
+ * SCHED_FIFO priority (the DT properties override the parameters), so they
+ * can be kept away from other softirq load.
+ *
+ * Return: '0' on success and failure value on error
+ */
+static int xilinx_dma_completion_thread_start(struct xilinx_dma_chan *chan,
+					      struct device_node *node)
+{
+	struct sched_param param = { .sched_priority = completion_priority };
+	struct task_struct *task;
+	bool enable = completion_thread;
+	int cpu = completion_cpu;
+	u32 val;
+
+	if (!of_property_read_u32(node, "xlnx,completion-cpu", &val)) {
+		cpu = val;
+		enable = true;
+	}
+
+	if (!of_property_read_u32(node, "xlnx,completion-priority", &val)) {
+		param.sched_priority = val;
+		enable = true;
+	}
+
+	if (!enable)
+		return 0;
+
+	if (cpu >= (int)nr_cpu_ids || (cpu >= 0 && !cpu_online(cpu))) {
+		dev_err(chan->dev, "Invalid completion CPU %d.\n", cpu);
+		return -EINVAL;
+	}
+
+	if (param.sched_priority < 0 || param.sched_priority >= MAX_RT_PRIO) {
+		dev_err(chan->dev, "Invalid completion priority %d.\n",
+			param.sched_priority);
+		return -EINVAL;
+	}
+
+	/* Channels can share an IRQ (MCDMA), so the name has the channel id. */
+	task = kthread_create(xilinx_dma_completion_thread, chan, "xdma/%d-%d",
+			      chan->irq, chan->id);
+	if (IS_ERR(task))
+		return PTR_ERR(task);
+
+	/* Not kthread_bind(), so the thread survives the CPU going offline. */
+	if (cpu >= 0)
+		set_cpus_allowed_ptr(task, cpumask_of(cpu));
+
+	if (param.sched_priority)
+		sched_setscheduler(task, SCHED_FIFO, &param);
+
+	chan->completion_task = task;
+	wake_up_process(task);
+
+	return 0;
+}
+
 
 /**
  * xilinx_dma_tx_submit - Submit DMA transaction
@@ -738,27 +1452,36 @@ static dma_cookie_t xilinx_dma_tx_submit(struct dma_async_tx_descriptor *tx)
 
 	dma_cookie_t cookie;
 	unsigned long flags;
-	int err;
 
-	if (chan->status == CHAN_ERROR) {
-		/* Try recovery */
-		dev_warn(chan->dev, "Channel %s (%p) is in error state.  Attempting reset.\n",
+	/* A channel in error state is recovered by xilinx_dma_recover_work(),
+	 * which replays the pending queue, so only refuse new transactions
+	 * once the recovery gave up.
+	 */
+	if (chan->xdev->reset_failed) {
+		dev_err(chan->dev, "Reset failed for channel %s (%p).  Driver in-operable.\n",
 			chan->name, chan);
 
-		err = xilinx_dma_hw_reset(chan); /* careful, DMA reset, resets both channels! */
-		if (err < 0) {
-
-			dev_err(chan->dev, "Reset failed for channel %s (%p).  Driver in-operable.\n",
-				chan->name, chan);
-
-			xilinx_dma_free_tx_descriptor(chan, desc);
-			return -EIO;
-		}
+		xilinx_dma_free_tx_descriptor(chan, desc);
+		return -EIO;
 	}
 
 	/* Don't interrupt adding the transaction. */
 	spin_lock_irqsave(&chan->lock, flags);
 
+	/* A cyclic transaction never completes, so nothing queued behind it
+	 * would ever run.
+	 */
+	if (chan->cyclic) {
+		spin_unlock_irqrestore(&chan->lock, flags);
+		dev_warn(chan->dev, "Channel %s is running a cyclic transaction.\n",
+			 chan->name);
+		xilinx_dma_free_tx_descriptor(chan, desc);
+		return -EBUSY;
+	}
+
+	if (desc->cyclic)
+		chan->cyclic = true;
+
 	/* Assign a new cookie to this transaction.
 	 * This assignment assigns cookie+1 and sets chan and tx cookie to the new value.
 	 * If an overflow happens, cookie is assigned to 1.
@@ -767,6 +1490,9 @@ static dma_cookie_t xilinx_dma_tx_submit(struct dma_async_tx_descriptor *tx)
 
 	/* Put this transaction onto the tail of the pending queue. */
 	list_add_tail(&desc->node, &chan->pending_transactions);
+	chan->pending_count++;
+
+	trace_xilinx_dma_dr_tx_submit(chan->name, cookie, desc->requested_length, 0);
 
 	spin_unlock_irqrestore(&chan->lock, flags);
 
@@ -827,6 +1553,7 @@ static struct dma_async_tx_descriptor *xilinx_dma_prep_slave_sg(
 	desc->async_tx.tx_submit = xilinx_dma_tx_submit;
 
 
+	desc->async_tx.flags = flags;
 	desc->async_tx.phys = sg_dma_address(sgl);
 	desc->requested_length =  sg_dma_len(sgl);
 	desc->transferred_length = 0;
@@ -838,6 +1565,172 @@ static struct dma_async_tx_descriptor *xilinx_dma_prep_slave_sg(
 //	return NULL;
 }
 
+/**
+ * xilinx_dma_prep_dma_cyclic - prepare a cyclic DMA_SLAVE transaction
+ * @dchan: DMA channel
+ * @buf_addr: Physical address of the ring buffer
+ * @buf_len: Length of the ring buffer
+ * @period_len: Length of one period, the callback runs after each period
+ * @direction: DMA direction
+ * @flags: transfer ack flags
+ *
+ * The ring is transferred one period at a time, the IRQ handler re-arms the
+ * next period directly.  dmaengine_tx_status() reports the residue from the
+ * start of the period currently being transferred.
+ *
+ * Return: Async transaction descriptor on success and NULL on failure
+ */
+static struct dma_async_tx_descriptor *xilinx_dma_prep_dma_cyclic(
+	struct dma_chan *dchan, dma_addr_t buf_addr, size_t buf_len,
+	size_t period_len, enum dma_transfer_direction direction,
+	unsigned long flags)
+{
+	struct xilinx_dma_chan *chan = to_xilinx_chan(dchan);
+	struct xilinx_dma_tx_descriptor *desc;
+
+	if (direction != chan->direction) {
+		dev_warn(chan->dev, "Direction of transaction and channel must be the same.\n");
+		return NULL;
+	}
+
+	if (!buf_len || !period_len || buf_len % period_len != 0) {
+		dev_warn(chan->dev, "Buffer length must be a multiple of the period length.\n");
+		return NULL;
+	}
+
+	/* The residue is reported from the u32 requested_length. */
+	if (buf_len > U32_MAX) {
+		dev_warn(chan->dev, "Buffer length doesn't fit the 32-bit transfer length.\n");
+		return NULL;
+	}
+
+	if (period_len > chan->max_transaction_length) {
+		dev_warn(chan->dev,
+			"Period longer than maximum allowed by the Xilinx core (%d).\n",
+			chan->max_transaction_length);
+		return NULL;
+	}
+
+	/* Allocate a transaction descriptor. */
+	desc = xilinx_dma_alloc_tx_descriptor(chan);
+	if (!desc)
+		return NULL;
+
+	/* Initialize the common descriptor from dmaengine.h. */
+	dma_async_tx_descriptor_init(&desc->async_tx, &chan->common);
+	desc->async_tx.tx_submit = xilinx_dma_tx_submit;
+
+	desc->async_tx.flags = flags;
+	desc->async_tx.phys = buf_addr;
+	desc->requested_length = buf_len;
+	desc->transferred_length = 0;
+
+	desc->cyclic = true;
+	desc->period_len = period_len;
+	desc->num_periods = buf_len / period_len;
+
+	return &desc->async_tx;
+}
+
+
+/**
+ * xilinx_dma_pause - Stop issuing transactions
+ * @dchan: DMA Channel pointer
+ *
+ * The active transaction (or cyclic period) can't be stopped without halting
+ * the hardware, so it is left to complete.  No pending transaction or cyclic
+ * period is started until the channel is resumed, and all queued and
+ * completed transactions are kept.
+ *
+ * Return: '0' always
+ */
+static int xilinx_dma_pause(struct dma_chan *dchan)
+{
+	struct xilinx_dma_chan *chan = to_xilinx_chan(dchan);
+	unsigned long flags;
+
+	spin_lock_irqsave(&chan->lock, flags);
+	chan->paused = true;
+	spin_unlock_irqrestore(&chan->lock, flags);
+
+	return 0;
+}
+
+/**
+ * xilinx_dma_resume - Resume issuing transactions after xilinx_dma_pause()
+ * @dchan: DMA Channel pointer
+ *
+ * Return: '0' always
+ */
+static int xilinx_dma_resume(struct dma_chan *dchan)
+{
+	struct xilinx_dma_chan *chan = to_xilinx_chan(dchan);
+	struct xilinx_dma_tx_descriptor *at;
+	unsigned long flags;
+
+	spin_lock_irqsave(&chan->lock, flags);
+
+	chan->paused = false;
+
+	at = chan->active_transaction;
+	if (at && at->cyclic && at->stalled)
+		xilinx_dma_cyclic_start_period(chan, at);
+	else
+		xilinx_dma_start_transfer_irq(chan);
+
+	spin_unlock_irqrestore(&chan->lock, flags);
+
+	return 0;
+}
+
+/**
+ * xilinx_dma_device_config - Configure the DMA channel
+ * @dchan: DMA channel
+ * @config: channel configuration
+ *
+ * In direct-register mode there is nothing to tune: the interrupt threshold
+ * and delay timer of DMACR are only used in scatter-gather mode, and cache
+ * attributes only exist in the BDs.  The configuration is accepted as long as
+ * it matches the channel, ie the direction (if set) matches, the address
+ * width fits the stream, and the burst (which selects the interrupt
+ * coalescing in xilinx-dma-sg) is 0 or 1, ie one interrupt per transaction.
+ *
+ * Return: '0' on success and -EINVAL on an unsupported configuration
+ */
+static int xilinx_dma_device_config(struct dma_chan *dchan,
+				    struct dma_slave_config *config)
+{
+	struct xilinx_dma_chan *chan = to_xilinx_chan(dchan);
+	enum dma_slave_buswidth addr_width;
+	u32 burst;
+
+	if (is_slave_direction(config->direction) &&
+	    config->direction != chan->direction) {
+		dev_warn(chan->dev, "Direction of config and channel must be the same.\n");
+		return -EINVAL;
+	}
+
+	if (chan->direction == DMA_DEV_TO_MEM) {
+		addr_width = config->src_addr_width;
+		burst = config->src_maxburst;
+	} else {
+		addr_width = config->dst_addr_width;
+		burst = config->dst_maxburst;
+	}
+
+	if (addr_width > chan->width) {
+		dev_warn(chan->dev, "Address width %d wider than the stream (%d).\n",
+			 addr_width, chan->width);
+		return -EINVAL;
+	}
+
+	if (burst > 1) {
+		dev_warn(chan->dev, "Interrupt coalescing requires scatter-gather mode.\n");
+		return -EINVAL;
+	}
+
+	return 0;
+}
 
 /**
  * xilinx_dma_terminate_all - Halt the channel and free descriptors
@@ -907,7 +1800,9 @@ static int xilinx_dma_chan_probe(struct xilinx_dma_device *xdev,
 	chan->dev = xdev->dev;
 	chan->xdev = xdev;
 	chan->status = CHAN_IDLE;
+	chan->running = false;
 	chan->id = chan_id;
+	chan->width = width;
 
 	if (of_device_is_compatible(node, "xlnx,axi-dma-mm2s-channel")) {
 		/* Set channel as a Memory to Stream. */
@@ -932,13 +1827,21 @@ static int xilinx_dma_chan_probe(struct xilinx_dma_device *xdev,
 	spin_lock_init(&chan->lock);
 	INIT_LIST_HEAD(&chan->pending_transactions);
 	INIT_LIST_HEAD(&chan->completed_transactions);
+	INIT_LIST_HEAD(&chan->free_descriptors);
 	chan->active_transaction = NULL;
 
+	/* Allocate the per-CPU statistics (zeroed). */
+	chan->stats = alloc_percpu(struct xilinx_dma_chan_stats);
+	if (!chan->stats) {
+		return -ENOMEM;
+	}
+
 	/* Reset the hardware. */
 	err = xilinx_dma_hw_reset(chan);  /* careful, dma reset must reset both channels */
 	if (err) {
 		dev_err(xdev->dev, "Reset channel %s (%p) failed.\n",
 			chan->name, chan);
+		free_percpu(chan->stats);
 		return err;
 	}
 
@@ -956,6 +1859,7 @@ static int xilinx_dma_chan_probe(struct xilinx_dma_device *xdev,
 			chan->name);
 		dev_err(xdev->dev, "The Xilinx DMA core is likely configured in scatter-gather mode "
 				"instead of direct-register mode.\n");
+		free_percpu(chan->stats);
 		return -EIO;
 	}
 
@@ -963,12 +1867,22 @@ static int xilinx_dma_chan_probe(struct xilinx_dma_device *xdev,
 	/* Find the IRQ line, if it exists in the device tree. */
 	chan->irq = irq_of_parse_and_map(node, 0);
 
+	/* Move completion processing to a thread if configured. */
+	err = xilinx_dma_completion_thread_start(chan, node);
+	if (err) {
+		free_percpu(chan->stats);
+		return err;
+	}
+
 	/* Request the interrupt and link it to a handler. */
 	err = request_irq(chan->irq, xilinx_dma_irq_handler,
 			  IRQF_SHARED, chan->name, chan);
 	if (err) {
 		dev_err(xdev->dev, "Unable to request IRQ %d for channel %s (%p).\n",
 			chan->irq, chan->name, chan);
+		if (chan->completion_task)
+			kthread_stop(chan->completion_task);
+		free_percpu(chan->stats);
 		return err;
 	}
 
@@ -981,6 +1895,11 @@ static int xilinx_dma_chan_probe(struct xilinx_dma_device *xdev,
 	list_add_tail(&chan->common.device_node, &xdev->common.channels);
 	xdev->chan[chan->id] = chan;
 
+	/* Expose the statistics, failure to do so is not fatal. */
+	chan->debugfs = debugfs_create_dir(chan->name, xdev->debugfs);
+	debugfs_create_file("stats", S_IRUGO, chan->debugfs, chan,
+			    &xilinx_dma_stats_fops);
+
 	dev_info(xdev->dev, "Probed channel %s with IRQ %d and max transaction length of %d.\n",
 		chan->name, chan->irq, chan->max_transaction_length);
 
@@ -1001,7 +1920,12 @@ static void xilinx_dma_chan_remove(struct xilinx_dma_chan *chan)
 
 	tasklet_kill(&chan->tasklet);
 
+	if (chan->completion_task)
+		kthread_stop(chan->completion_task);
+
 	list_del(&chan->common.device_node);
+
+	free_percpu(chan->stats);
 }
 
 
@@ -1064,6 +1988,7 @@ static int xilinx_dma_probe(struct platform_device *pdev)
 	struct xilinx_dma_device *xdev;
 	struct device_node *child, *node;
 	struct resource *res;
+	u32 addr_width;
 	int i, ret;
 
 	/* Allocate Xilinx version of the device. */
@@ -1073,6 +1998,7 @@ static int xilinx_dma_probe(struct platform_device *pdev)
 
 	xdev->dev = &(pdev->dev);
 	INIT_LIST_HEAD(&xdev->common.channels);
+	INIT_WORK(&xdev->recover_work, xilinx_dma_recover_work);
 
 	node = pdev->dev.of_node;
 
@@ -1093,11 +2019,36 @@ static int xilinx_dma_probe(struct platform_device *pdev)
 		return -EIO;
 	}
 
+	/* Retrieve the DMA engine address width, which defaults to 32. */
+	ret = of_property_read_u32(node, "xlnx,addrwidth", &addr_width);
+	if (ret < 0)
+		addr_width = 32;
+
+	if (addr_width < 32 || addr_width > 64) {
+		dev_err(&pdev->dev, "Invalid address width %d.\n", addr_width);
+		return -EINVAL;
+	}
+
+	xdev->ext_addr = addr_width > 32;
+
+	/* Let the DMA API place buffers anywhere the core can reach. */
+	ret = dma_set_mask_and_coherent(&pdev->dev, DMA_BIT_MASK(addr_width));
+	if (ret) {
+		dev_err(&pdev->dev, "Unable to set DMA mask for %d address bits.\n",
+			addr_width);
+		return ret;
+	}
+
 	/* Axi DMA only do slave transfers */
 	dma_cap_set(DMA_SLAVE, xdev->common.cap_mask);
 	dma_cap_set(DMA_PRIVATE, xdev->common.cap_mask);
+	dma_cap_set(DMA_CYCLIC, xdev->common.cap_mask);
 
 	xdev->common.device_prep_slave_sg = xilinx_dma_prep_slave_sg;
+	xdev->common.device_prep_dma_cyclic = xilinx_dma_prep_dma_cyclic;
+	xdev->common.device_config = xilinx_dma_device_config;
+	xdev->common.device_pause = xilinx_dma_pause;
+	xdev->common.device_resume = xilinx_dma_resume;
 	xdev->common.device_terminate_all = xilinx_dma_terminate_all;
 	xdev->common.device_issue_pending = xilinx_dma_issue_pending;
 	xdev->common.device_alloc_chan_resources =
@@ -1117,6 +2068,9 @@ static int xilinx_dma_probe(struct platform_device *pdev)
 
 	platform_set_drvdata(pdev, xdev);
 
+	/* Per-channel statistics directories are created under this one. */
+	xdev->debugfs = debugfs_create_dir(dev_name(&pdev->dev), NULL);
+
 	for_each_child_of_node(node, child) {
 		ret = xilinx_dma_channel_probe(xdev, child);
 		if (ret) {
@@ -1139,6 +2093,9 @@ static int xilinx_dma_probe(struct platform_device *pdev)
 	return 0;
 
 free_chan_resources:
+	cancel_work_sync(&xdev->recover_work);
+	debugfs_remove_recursive(xdev->debugfs);
+
 	for (i = 0; i < xdev->nr_channels; i++)
 		if (xdev->chan[i])
 			xilinx_dma_chan_remove(xdev->chan[i]);
@@ -1160,6 +2117,9 @@ static int xilinx_dma_remove(struct platform_device *pdev)
 	of_dma_controller_free(pdev->dev.of_node);
 	dma_async_device_unregister(&xdev->common);
 
+	cancel_work_sync(&xdev->recover_work);
+	debugfs_remove_recursive(xdev->debugfs);
+
 	for (i = 0; i < xdev->nr_channels; i++)
 		if (xdev->chan[i])
 			xilinx_dma_chan_remove(xdev->chan[i]);
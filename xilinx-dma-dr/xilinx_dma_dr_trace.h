@@ -0,0 +1,119 @@
+/*
+ * Tracepoints for the Xilinx DMA Engine direct-register mode driver.
+ *
+ * Copyright (C) 2016 Ping DSP, Inc. All rights reserved.
+ *
+ * Description:
+ *  Every event carries the channel name, the transaction cookie, the
+ *  requested length and the transferred length, so the time a transaction
+ *  spends queued, in the hardware and waiting for its callback can be
+ *  reconstructed from a trace, ie:
+ *
+ *    echo 1 > /sys/kernel/debug/tracing/events/xilinx_dma_dr/enable
+ *    cat /sys/kernel/debug/tracing/trace_pipe
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM xilinx_dma_dr
+
+#if !defined(_XILINX_DMA_DR_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _XILINX_DMA_DR_TRACE_H
+
+#include <linux/tracepoint.h>
+
+DECLARE_EVENT_CLASS(xilinx_dma_dr_transaction,
+
+	TP_PROTO(const char *chan, dma_cookie_t cookie, u32 requested,
+		 u32 transferred),
+
+	TP_ARGS(chan, cookie, requested, transferred),
+
+	TP_STRUCT__entry(
+		__string(chan, chan)
+		__field(dma_cookie_t, cookie)
+		__field(u32, requested)
+		__field(u32, transferred)
+	),
+
+	TP_fast_assign(
+		__assign_str(chan, chan);
+		__entry->cookie = cookie;
+		__entry->requested = requested;
+		__entry->transferred = transferred;
+	),
+
+	TP_printk("chan=%s cookie=%d requested=%u transferred=%u",
+		  __get_str(chan), __entry->cookie, __entry->requested,
+		  __entry->transferred)
+);
+
+/* Transaction queued on the pending list by dmaengine_submit(). */
+DEFINE_EVENT(xilinx_dma_dr_transaction, xilinx_dma_dr_tx_submit,
+	TP_PROTO(const char *chan, dma_cookie_t cookie, u32 requested,
+		 u32 transferred),
+	TP_ARGS(chan, cookie, requested, transferred)
+);
+
+/* Transaction handed to the hardware (BTT written). */
+DEFINE_EVENT(xilinx_dma_dr_transaction, xilinx_dma_dr_start_transfer,
+	TP_PROTO(const char *chan, dma_cookie_t cookie, u32 requested,
+		 u32 transferred),
+	TP_ARGS(chan, cookie, requested, transferred)
+);
+
+/* Active transaction moved to the completed transactions list. */
+DEFINE_EVENT(xilinx_dma_dr_transaction, xilinx_dma_dr_complete,
+	TP_PROTO(const char *chan, dma_cookie_t cookie, u32 requested,
+		 u32 transferred),
+	TP_ARGS(chan, cookie, requested, transferred)
+);
+
+/* Client callback about to be run from the tasklet. */
+DEFINE_EVENT(xilinx_dma_dr_transaction, xilinx_dma_dr_callback,
+	TP_PROTO(const char *chan, dma_cookie_t cookie, u32 requested,
+		 u32 transferred),
+	TP_ARGS(chan, cookie, requested, transferred)
+);
+
+/* Interrupt taken, with the DMASR value and the active transaction (if any). */
+TRACE_EVENT(xilinx_dma_dr_irq,
+
+	TP_PROTO(const char *chan, u32 status, dma_cookie_t cookie,
+		 u32 requested, u32 transferred),
+
+	TP_ARGS(chan, status, cookie, requested, transferred),
+
+	TP_STRUCT__entry(
+		__string(chan, chan)
+		__field(u32, status)
+		__field(dma_cookie_t, cookie)
+		__field(u32, requested)
+		__field(u32, transferred)
+	),
+
+	TP_fast_assign(
+		__assign_str(chan, chan);
+		__entry->status = status;
+		__entry->cookie = cookie;
+		__entry->requested = requested;
+		__entry->transferred = transferred;
+	),
+
+	TP_printk("chan=%s status=0x%08x cookie=%d requested=%u transferred=%u",
+		  __get_str(chan), __entry->status, __entry->cookie,
+		  __entry->requested, __entry->transferred)
+);
+
+#endif /* _XILINX_DMA_DR_TRACE_H */
+
+/* This part must be outside protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE xilinx_dma_dr_trace
+#include <trace/define_trace.h>
@@ -21,18 +21,25 @@
 
 #include <linux/dma/xilinx_dma.h>
 #include <linux/bitops.h>
+#include <linux/genalloc.h>
+#include <linux/hrtimer.h>
 #include <linux/init.h>
 #include <linux/interrupt.h>
 #include <linux/io.h>
 #include <linux/iopoll.h>
+#include <linux/kthread.h>
 #include <linux/module.h>
 #include <linux/of_address.h>
 #include <linux/of_dma.h>
 #include <linux/of_irq.h>
 #include <linux/of_platform.h>
+#include <linux/prefetch.h>
+#include <linux/sched.h>
 #include <linux/slab.h>
+#include <linux/workqueue.h>
 
 #include "dmaengine.h"
+#include "xilinx_dma_sg.h"
 
 /* Register Offsets */
 #define XILINX_DMA_REG_CONTROL		0x00
@@ -70,8 +77,12 @@
 
 /* BD definitions */
 #define XILINX_DMA_BD_STS_ALL_MASK	GENMASK(31, 28)
+#define XILINX_DMA_BD_CMPLT		BIT(31)
 #define XILINX_DMA_BD_SOP		BIT(27)
 #define XILINX_DMA_BD_EOP		BIT(26)
+#define XILINX_DMA_BD_STS_ERR_MASK	GENMASK(30, 28)
+#define XILINX_DMA_BD_RXSOF		BIT(27)
+#define XILINX_DMA_BD_RXEOF		BIT(26)
 
 /* Multi-Channel DMA Descriptor offsets*/
 #define XILINX_DMA_MCRX_CDESC(x)	(0x40 + (x-1) * 0x20)
@@ -84,17 +95,44 @@
 #define XILINX_DMA_BD_STRIDE_SHIFT   0
 #define XILINX_DMA_BD_VSIZE_SHIFT    19
 
+#define XILINX_DMA_BD_HSIZE_MAX     XILINX_DMA_BD_HSIZE_MASK
+#define XILINX_DMA_BD_STRIDE_MAX    XILINX_DMA_BD_STRIDE_MASK
+#define XILINX_DMA_BD_VSIZE_MAX     (XILINX_DMA_BD_VSIZE_MASK >> XILINX_DMA_BD_VSIZE_SHIFT)
+
 /* Hw specific definitions */
 #define XILINX_DMA_MAX_CHANS_PER_DEVICE	0x20
+#define XILINX_DMA_MCDMA_MAX_CHANS	16
 #define XILINX_DMA_MAX_TRANS_LEN	GENMASK(22, 0)
 
 /* Delay loop counter to prevent hardware failure */
 #define XILINX_DMA_LOOP_COUNT		1000000
 
-/* Maximum number of Descriptors */
+/* Time a healthy channel is given to finish its active chain before the
+ * error recovery resets the core under it.
+ */
+#define XILINX_DMA_RECOVER_DRAIN_US	1000
+
+/* Completed transactions kept for tx_status(), a power of 2 */
+#define XILINX_DMA_TX_HISTORY		32
+#define XILINX_DMA_PERIPHERAL_ID	0x000A3500
+
+/* Default and maximum number of Descriptors (BDs) per channel */
 #define XILINX_DMA_NUM_DESCS		255
+#define XILINX_DMA_MAX_DESCS		65536
+#define XILINX_DMA_BD_ALIGN		64
 #define XILINX_DMA_COALESCE_MAX		255
-#define XILINX_DMA_NUM_APP_WORDS	5
+
+/* BD ring size, used when a channel is allocated unless its node sets
+ * xlnx,num-descs.
+ */
+static unsigned int num_descs = XILINX_DMA_NUM_DESCS;
+module_param(num_descs, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(num_descs, "Number of BDs per channel (2-65536), applied when a channel is allocated");
+
+/* Interrupt delay timer, applied to every channel. */
+static unsigned int irq_delay;
+module_param(irq_delay, uint, S_IRUGO);
+MODULE_PARM_DESC(irq_delay, "Default interrupt delay timer (IRQDelay) of the channels in units of 125 stream clocks, 0 for the minimum needed by coalescing (max 255)");
 
 #define mm2s_mcdmatx_control(tdest, tid, tuser, axcache, aruser) \
 			     ((aruser << 28) | (axcache << 24) | \
@@ -103,10 +141,33 @@
 #define mm2s_mcdmarx_control(axcache, aruser) \
 			     ((aruser << 28) | (axcache << 24))
 
+/* Completion processing, see xilinx_dma_completion_thread_start(). */
+static bool completion_thread;
+module_param(completion_thread, bool, S_IRUGO);
+MODULE_PARM_DESC(completion_thread, "Run completions (callbacks) in a kernel thread per channel instead of a tasklet");
+
+static int completion_cpu = -1;
+module_param(completion_cpu, int, S_IRUGO);
+MODULE_PARM_DESC(completion_cpu, "CPU the completion threads run on, -1 for any");
+
+static unsigned int completion_priority;
+module_param(completion_priority, uint, S_IRUGO);
+MODULE_PARM_DESC(completion_priority, "SCHED_FIFO priority of the completion threads (1-99), 0 for SCHED_NORMAL");
+
+/* Polled completion, see xilinx_dma_poll(). */
+static unsigned int poll_us;
+module_param(poll_us, uint, S_IRUGO);
+MODULE_PARM_DESC(poll_us, "Poll the BD status every poll_us microseconds instead of using completion interrupts, 0 to use interrupts (SG mode only)");
+
 #define xilinx_dma_poll_timeout(chan, reg, val, cond, delay_us, timeout_us) \
 	readl_poll_timeout(chan->xdev->regs + chan->ctrl_offset + reg, val, \
 			   cond, delay_us, timeout_us)
 
+/* For the start and halt polls, which run with the channel lock held. */
+#define xilinx_dma_poll_timeout_atomic(chan, reg, val, cond, delay_us, timeout_us) \
+	readl_poll_timeout_atomic(chan->xdev->regs + chan->ctrl_offset + reg, \
+				  val, cond, delay_us, timeout_us)
+
 /**
  * struct xilinx_dma_desc_hw - Hardware Descriptor
  * @next_desc: Next Descriptor Pointer @0x00
@@ -131,28 +192,72 @@ struct xilinx_dma_desc_hw {
 
 /**
  * struct xilinx_dma_tx_segment - Descriptor segment
- * @hw: Hardware descriptor
+ * @hw: Hardware descriptor, in the BD array of the channel
  * @node: Node in the descriptor segments list
- * @phys: Physical address of segment
+ * @phys: Physical address of @hw
+ * @retired: Freed, waiting for the ring tail to pass it
+ *
+ * The segments are a shadow array of the BDs in normal memory, so the list
+ * and ring bookkeeping never shares a cache line with a BD the engine
+ * writes back.
  */
 struct xilinx_dma_tx_segment {
-	struct xilinx_dma_desc_hw hw;
+	struct xilinx_dma_desc_hw *hw;
 	struct list_head node;
 	dma_addr_t phys;
-} __aligned(64);
+	bool retired;
+};
 
 /**
  * struct xilinx_dma_tx_descriptor - Per Transaction structure
  * @async_tx: Async transaction descriptor
  * @segments: TX segments list
  * @node: Node in the channel descriptors list
- * @direction: Transfer direction
+ * @cyclic: Transaction is a cyclic ring of segments
+ * @requested_length: Sum of the segment lengths
+ * @period_len: Length of one period of a cyclic transaction
+ * @num_periods: Number of periods in the ring of a cyclic transaction
+ * @period_segs: Number of segments (BDs) per period of a cyclic transaction
+ * @cur_seg: Next segment of a cyclic transaction to complete
+ * @seg_in_period: Completed segments of the current period
+ * @period: Period the hardware is currently transferring
+ * @periods_elapsed: Periods completed but not yet reported by the callback
+ * @retired: Freed, waiting for the descriptor ring tail to pass it
  */
 struct xilinx_dma_tx_descriptor {
 	struct dma_async_tx_descriptor async_tx;
 	struct list_head segments;
 	struct list_head node;
 	bool cyclic;
+	u32 requested_length;
+	u32 period_len;
+	u32 num_periods;
+	u32 period_segs;
+	struct xilinx_dma_tx_segment *cur_seg;
+	u32 seg_in_period;
+	u32 period;
+	u32 periods_elapsed;
+	bool retired;
+};
+
+/**
+ * struct xilinx_dma_tx_result - Result of a completed transaction
+ * @cookie: Transaction identifier, the entry is chan->history[cookie % size]
+ * @requested_length: Sum of the segment lengths
+ * @transferred_length: Bytes transferred, from the BD status of the segments
+ * @error: A BD completed with DMAIntErr, DMASlvErr or DMADecErr
+ * @app: S2MM status stream APP words, from the BD where the packet ended
+ * @sof: In packet mode, the BD has RXSOF, a packet starts in it
+ * @eof: In packet mode, the BD has RXEOF, a packet ends in it
+ */
+struct xilinx_dma_tx_result {
+	dma_cookie_t cookie;
+	u32 requested_length;
+	u32 transferred_length;
+	bool error;
+	u32 app[XILINX_DMA_NUM_APP_WORDS];
+	bool sof;
+	bool eof;
 };
 
 /**
@@ -162,22 +267,56 @@ struct xilinx_dma_tx_descriptor {
  * @lock: Descriptor operation lock
  * @pending_list: Descriptors waiting
  * @active_list: Descriptors ready to submit
- * @done_list: Complete descriptors
- * @free_seg_list: Free descriptors
+ * @done_list: Complete descriptors, waiting for their callback
+ * @history: Results of the last completed transactions, indexed by cookie
+ * @seg_head: Index of the next segment to allocate from the ring
+ * @seg_tail: Index of the oldest segment still in use
+ * @descs: Transaction descriptors, a ring of @num_descs like the BDs
+ * @desc_head: Index of the next descriptor to allocate from @descs
+ * @desc_tail: Index of the oldest descriptor still in use
  * @common: DMA common channel
- * @seg_v: Statically allocated segments base
- * @seg_p: Physical allocated segments base
+ * @seg_v: Segments, the software state of the ring of BDs
+ * @bd_v: BDs, a dense array in coherent memory, one per segment
+ * @bd_p: Physical address of @bd_v
+ * @num_descs: Number of BDs in the ring while the channel is allocated
+ * @of_num_descs: Number of BDs from the device tree, 0 for num_descs
  * @dev: The dma device
  * @irq: Channel IRQ
  * @id: Channel ID
- * @has_sg: Support scatter transfers
+ * @has_sg: Support scatter transfers, detected from the hardware
+ * @max_transaction_length: Maximum length of a segment (BD or BTT)
+ * @dr_seg: Segment in flight in direct register mode
  * @idle: Check for channel idle
- * @err: Channel has errors
+ * @running: Channel has been started (DMACR.RS set and DMASR.Halted clear)
+ * @err: Channel halted on an error, until the error recovery restarts it
  * @tasklet: Cleanup work after irq
+ * @completion_task: Completion thread, used instead of @tasklet if not NULL
+ * @completion_pending: Bit 0 is set when @completion_task has work to do
+ * @poll_timer: Completes descriptors from the BD status instead of the IOC
+ *              and delay interrupts
+ * @poll_period: Period of @poll_timer, 0 to use the interrupts
  * @residue: Residue
  * @desc_pendingcount: Descriptor pending count
  * @cyclic_seg_v: Statically allocated segments base for cyclic dma
  * @cyclic_seg_p: Physical allocated segments base for cyclic dma
+ * @tail_next_p: next_desc of the last BD written to TAILDESC, as the engine
+ *               fetched it; where a running chain resumes
+ * @bd_pool: On-chip memory (OCM/BRAM) pool for the BDs, NULL for DDR
+ * @bd_pool_v: Start of the allocation of @bd_v from @bd_pool, before
+ *             alignment; NULL when the BDs are in DDR
+ * @width: Stream data width in bytes
+ * @coalesce: Completed descriptors per interrupt (IRQThreshold), 0 for the
+ *            hardware maximum; set with dmaengine_slave_config()
+ * @irq_delay: Interrupt delay timer (IRQDelay) in units of 125 stream clocks,
+ *             0 for the minimum needed by coalescing; the irq_delay module
+ *             parameter unless set with xilinx_dma_channel_set_irq_delay()
+ * @paused: No new descriptors are issued to the hardware until resumed
+ * @resetting: Like @paused, but owned by the error recovery
+ * @tdest: TDEST of an S2MM channel in multichannel mode, selects its
+ *         CURDESC/TAILDESC registers; 0 otherwise
+ * @peri_id: Peripheral ID and direction, used by clients to filter channels
+ * @packet_mode: S2MM descriptors are single BDs, and a packet is the run of
+ *               them from RXSOF to RXEOF
  */
 struct xilinx_dma_chan {
 	struct xilinx_dma_device *xdev;
@@ -186,28 +325,53 @@ struct xilinx_dma_chan {
 	struct list_head pending_list;
 	struct list_head done_list;
 	struct list_head active_list;
-	struct list_head free_seg_list;
+	struct xilinx_dma_tx_result history[XILINX_DMA_TX_HISTORY];
+	u32 seg_head;
+	u32 seg_tail;
+	struct xilinx_dma_tx_descriptor *descs;
+	u32 desc_head;
+	u32 desc_tail;
 	struct dma_chan common;
 	struct xilinx_dma_tx_segment *seg_v;
+	struct xilinx_dma_desc_hw *bd_v;
 	struct xilinx_mcdma_config config;
-	dma_addr_t seg_p;
+	dma_addr_t bd_p;
+	u32 num_descs;
+	u32 of_num_descs;
 	struct device *dev;
 	int irq;
 	int id;
 	enum dma_transfer_direction direction; 
 	bool has_sg;
+	u32 max_transaction_length;
+	struct xilinx_dma_tx_segment *dr_seg;
 	bool cyclic;
 	bool mcdma;
 	int err;
 	bool idle;
+	bool running;
 	struct tasklet_struct tasklet;
+	struct task_struct *completion_task;
+	unsigned long completion_pending;
+	struct hrtimer poll_timer;
+	ktime_t poll_period;
 	u32 residue;
 	u32 desc_pendingcount;
 	struct xilinx_dma_tx_segment *cyclic_seg_v;
 	dma_addr_t cyclic_seg_p;
+	dma_addr_t tail_next_p;
+	struct gen_pool *bd_pool;
+	void *bd_pool_v;
 
-	u16 tdest;   // added for multichannels support?
+	u16 tdest;
 	char *name;
+	u32 width;
+	u32 coalesce;
+	u32 irq_delay;
+	bool paused;
+	bool resetting;
+	u32 peri_id;
+	bool packet_mode;
 };
 
 /**
@@ -216,7 +380,13 @@ struct xilinx_dma_chan {
  * @dev: Device Structure
  * @common: DMA device structure
  * @chan: Driver specific DMA channel
- * @has_sg: Specifies whether Scatter-Gather is present or not
+ * @has_sg: Scatter-Gather is present according to the device tree, the
+ *          channels detect it from the hardware
+ * @recover_work: Error recovery, resets the core and restarts every channel;
+ *                also halts and restarts the S2MM engine for @mcdma_halt
+ * @reset_failed: Error recovery could not reset the core
+ * @mcdma_halt: A TDEST channel needs the S2MM engine halted to write its
+ *              CURDESC, see xilinx_dma_start_transfer()
  */
 struct xilinx_dma_device {
 	void __iomem *regs;
@@ -227,6 +397,9 @@ struct xilinx_dma_device {
 	bool mcdma;
 	u32 nr_channels;
 	u32 chan_id;
+	struct work_struct recover_work;
+	bool reset_failed;
+	bool mcdma_halt;
 };
 
 /* Macros */
@@ -300,71 +473,166 @@ static inline void dma_ctrl_set(struct xilinx_dma_chan *chan, u32 reg, u32 set)
  * Descriptors and segments alloc and free
  */
 
+/**
+ * xilinx_dma_reclaim_segments - Move the ring tail past the retired segments
+ * @chan: Driver specific dma channel
+ *
+ * Segments are given back to the ring in the order they were allocated.  A
+ * segment freed out of order (eg a prepared descriptor freed before an older
+ * one completes) stays retired until the ones before it are freed too.  Only
+ * the words the hardware writes or the prep functions rely on are cleared;
+ * next_desc is relinked because cyclic and chained descriptors rewrite it.
+ *
+ * Context: channel lock held
+ */
+static void xilinx_dma_reclaim_segments(struct xilinx_dma_chan *chan)
+{
+	u32 tail = chan->seg_tail;
+	u32 head = READ_ONCE(chan->seg_head);
+
+	while (tail != head) {
+		struct xilinx_dma_tx_segment *segment = &chan->seg_v[tail];
+		u32 next = (tail + 1) % chan->num_descs;
+
+		if (!READ_ONCE(segment->retired))
+			break;
+
+		segment->hw->next_desc = chan->seg_v[next].phys;
+		segment->hw->vsize_stride = 0;
+		segment->hw->control = 0;
+		segment->hw->status = 0;
+		segment->retired = false;
+		tail = next;
+	}
+
+	/* Publish the cleared segments to xilinx_dma_alloc_tx_segment(). */
+	smp_store_release(&chan->seg_tail, tail);
+}
+
 /**
  * xilinx_dma_alloc_tx_segment - Allocate transaction segment
  * @chan: Driver specific dma channel
  *
+ * Segments are taken from the head of the BD ring without the channel lock,
+ * so concurrent prep calls only race on the cmpxchg of the head index.  One
+ * BD is kept unused so a full ring can be told from an empty one.  When the
+ * ring looks full, the tail is moved past segments freed since the last
+ * reclaim before giving up.
+ *
  * Return: The allocated segment on success and NULL on failure.
  */
 static struct xilinx_dma_tx_segment *
 xilinx_dma_alloc_tx_segment(struct xilinx_dma_chan *chan)
 {
-	struct xilinx_dma_tx_segment *segment = NULL;
 	unsigned long flags;
+	u32 head, next;
 
-	spin_lock_irqsave(&chan->lock, flags);
-	if (!list_empty(&chan->free_seg_list)) {
-		segment = list_first_entry(&chan->free_seg_list,
-					   struct xilinx_dma_tx_segment,
-					   node);
-		list_del(&segment->node);
-	}
-	spin_unlock_irqrestore(&chan->lock, flags);
+	do {
+		head = READ_ONCE(chan->seg_head);
+		next = (head + 1) % chan->num_descs;
+
+		if (next == smp_load_acquire(&chan->seg_tail)) {
+			spin_lock_irqsave(&chan->lock, flags);
+			xilinx_dma_reclaim_segments(chan);
+			spin_unlock_irqrestore(&chan->lock, flags);
+
+			if (next == smp_load_acquire(&chan->seg_tail))
+				return NULL;
+		}
+	} while (cmpxchg(&chan->seg_head, head, next) != head);
 
-	return segment;
+	return &chan->seg_v[head];
 }
 
 /**
- * xilinx_dma_clean_hw_desc - Clean hardware descriptor
- * @hw: HW descriptor to clean
+ * xilinx_dma_free_tx_segment - Free transaction segment
+ * @chan: Driver specific dma channel
+ * @segment: dma transaction segment
+ *
+ * The segment is only marked, it goes back to the ring with the next
+ * xilinx_dma_reclaim_segments().
  */
-static void xilinx_dma_clean_hw_desc(struct xilinx_dma_desc_hw *hw)
+static void xilinx_dma_free_tx_segment(struct xilinx_dma_chan *chan,
+				       struct xilinx_dma_tx_segment *segment)
 {
-	dma_addr_t next_desc = hw->next_desc;
+	WRITE_ONCE(segment->retired, true);
+}
 
-	memset(hw, 0, sizeof(struct xilinx_dma_desc_hw));
+/**
+ * xilinx_dma_free_tx_segments - Free the segments of a transaction descriptor
+ * @chan: Driver specific dma channel
+ * @desc: dma transaction descriptor
+ */
+static void xilinx_dma_free_tx_segments(struct xilinx_dma_chan *chan,
+					struct xilinx_dma_tx_descriptor *desc)
+{
+	struct xilinx_dma_tx_segment *segment, *next;
 
-	hw->next_desc = next_desc;
+	list_for_each_entry_safe(segment, next, &desc->segments, node) {
+		list_del(&segment->node);
+		xilinx_dma_free_tx_segment(chan, segment);
+	}
 }
 
 /**
- * xilinx_dma_free_tx_segment - Free transaction segment
+ * xilinx_dma_reclaim_descriptors - Move the ring tail past the retired descriptors
  * @chan: Driver specific dma channel
- * @segment: dma transaction segment
+ *
+ * Descriptors come back in the order they were allocated, the same way as
+ * the segments in xilinx_dma_reclaim_segments().
+ *
+ * Context: channel lock held
  */
-static void xilinx_dma_free_tx_segment(struct xilinx_dma_chan *chan,
-				       struct xilinx_dma_tx_segment *segment)
+static void xilinx_dma_reclaim_descriptors(struct xilinx_dma_chan *chan)
 {
-	xilinx_dma_clean_hw_desc(&segment->hw);
+	u32 tail = chan->desc_tail;
+	u32 head = READ_ONCE(chan->desc_head);
+
+	while (tail != head) {
+		if (!READ_ONCE(chan->descs[tail].retired))
+			break;
+
+		tail = (tail + 1) % chan->num_descs;
+	}
 
-	list_add_tail(&segment->node, &chan->free_seg_list);
+	/* Publish the retired descriptors to xilinx_dma_alloc_tx_descriptor(). */
+	smp_store_release(&chan->desc_tail, tail);
 }
 
 /**
  * xilinx_dma_tx_descriptor - Allocate transaction descriptor
  * @chan: Driver specific dma channel
  *
+ * Descriptors are preallocated with the BD ring, one per BD, and taken from
+ * their own ring in the same lock-free way as the segments.  Every descriptor
+ * holds at least one BD, so they only run out when the BDs do, or when
+ * completed descriptors wait that long for their callbacks.
+ *
  * Return: The allocated descriptor on success and NULL on failure.
  */
 static struct xilinx_dma_tx_descriptor *
 xilinx_dma_alloc_tx_descriptor(struct xilinx_dma_chan *chan)
 {
 	struct xilinx_dma_tx_descriptor *desc;
+	unsigned long flags;
+	u32 head, next;
 
-	desc = kzalloc(sizeof(*desc), GFP_NOWAIT);
-	if (!desc)
-		return NULL;
+	do {
+		head = READ_ONCE(chan->desc_head);
+		next = (head + 1) % chan->num_descs;
+
+		if (next == smp_load_acquire(&chan->desc_tail)) {
+			spin_lock_irqsave(&chan->lock, flags);
+			xilinx_dma_reclaim_descriptors(chan);
+			spin_unlock_irqrestore(&chan->lock, flags);
 
+			if (next == smp_load_acquire(&chan->desc_tail))
+				return NULL;
+		}
+	} while (cmpxchg(&chan->desc_head, head, next) != head);
+
+	desc = &chan->descs[head];
+	memset(desc, 0, sizeof(*desc));
 	INIT_LIST_HEAD(&desc->segments);
 
 	return desc;
@@ -379,17 +647,101 @@ static void
 xilinx_dma_free_tx_descriptor(struct xilinx_dma_chan *chan,
 			      struct xilinx_dma_tx_descriptor *desc)
 {
-	struct xilinx_dma_tx_segment *segment, *next;
-
 	if (!desc)
 		return;
 
-	list_for_each_entry_safe(segment, next, &desc->segments, node) {
-		list_del(&segment->node);
-		xilinx_dma_free_tx_segment(chan, segment);
+	xilinx_dma_free_tx_segments(chan, desc);
+
+	WRITE_ONCE(desc->retired, true);
+}
+
+/**
+ * xilinx_dma_alloc_bds - Allocate the BD ring and the cyclic tail BD
+ * @chan: Driver specific dma channel
+ *
+ * Both are allocated together, the cyclic tail BD after the ring, from the
+ * on-chip memory pool of the channel if it has one, so the engine fetches
+ * BDs and writes their status without going through the DDR controller.
+ * The pool granularity may be less than the BD alignment, so the
+ * allocation is aligned here.  When the pool is too small the BDs go to
+ * DDR.  The segments, which only the CPU uses, are allocated separately.
+ *
+ * Return: '0' on success and -ENOMEM on failure
+ */
+static int xilinx_dma_alloc_bds(struct xilinx_dma_chan *chan)
+{
+	size_t size = sizeof(*chan->bd_v) * (chan->num_descs + 1);
+	dma_addr_t phys;
+	void *virt;
+	int i;
+
+	chan->seg_v = kvcalloc(chan->num_descs + 1, sizeof(*chan->seg_v),
+			       GFP_KERNEL);
+	if (!chan->seg_v)
+		return -ENOMEM;
+
+	chan->bd_pool_v = NULL;
+	if (chan->bd_pool) {
+		virt = gen_pool_dma_alloc(chan->bd_pool,
+					  size + XILINX_DMA_BD_ALIGN, &phys);
+		if (virt) {
+			chan->bd_pool_v = virt;
+			chan->bd_v = PTR_ALIGN(virt, XILINX_DMA_BD_ALIGN);
+			chan->bd_p = phys + ((void *)chan->bd_v - virt);
+			memset(chan->bd_v, 0, size);
+		} else {
+			dev_warn(chan->dev, "Channel %s BDs don't fit in the pool, using DDR.\n",
+				 chan->name);
+		}
+	}
+
+	if (!chan->bd_pool_v) {
+		chan->bd_v = dma_zalloc_coherent(chan->dev, size,
+						 &chan->bd_p, GFP_KERNEL);
+		if (!chan->bd_v) {
+			kvfree(chan->seg_v);
+			chan->seg_v = NULL;
+			return -ENOMEM;
+		}
+	}
+
+	for (i = 0; i <= chan->num_descs; i++) {
+		chan->seg_v[i].hw = &chan->bd_v[i];
+		chan->seg_v[i].phys = chan->bd_p + sizeof(*chan->bd_v) * i;
 	}
 
-	kfree(desc);
+	/*
+	 * For Cyclic DMA We need to Program the Tail Descriptor
+	 * register with some value which is not a part of the BD chain
+	 * So allocating a desc segment during channel allocation for
+	 * programming tail descriptor.
+	 */
+	chan->cyclic_seg_v = &chan->seg_v[chan->num_descs];
+	chan->cyclic_seg_p = chan->cyclic_seg_v->phys;
+
+	return 0;
+}
+
+/**
+ * xilinx_dma_free_bds - Free the BD ring and the cyclic tail BD
+ * @chan: Driver specific dma channel
+ */
+static void xilinx_dma_free_bds(struct xilinx_dma_chan *chan)
+{
+	size_t size = sizeof(*chan->bd_v) * (chan->num_descs + 1);
+
+	if (chan->bd_pool_v)
+		gen_pool_free(chan->bd_pool, (unsigned long)chan->bd_pool_v,
+			      size + XILINX_DMA_BD_ALIGN);
+	else
+		dma_free_coherent(chan->dev, size, chan->bd_v, chan->bd_p);
+
+	kvfree(chan->seg_v);
+
+	chan->bd_pool_v = NULL;
+	chan->bd_v = NULL;
+	chan->seg_v = NULL;
+	chan->cyclic_seg_v = NULL;
 }
 
 /**
@@ -403,57 +755,54 @@ static int xilinx_dma_alloc_chan_resources(struct dma_chan *dchan)
 	struct xilinx_dma_chan *chan = to_xilinx_chan(dchan);
 	int i;
 
+	/* The ring size is fixed while the channel is allocated, a change of
+	 * the module parameter applies from the next allocation.
+	 */
+	chan->num_descs = chan->of_num_descs;
+	if (!chan->num_descs) {
+		chan->num_descs = clamp_t(u32, READ_ONCE(num_descs), 2,
+					  XILINX_DMA_MAX_DESCS);
+		if (chan->num_descs != num_descs)
+			dev_warn(chan->dev, "num_descs %u out of range, using %u.\n",
+				 num_descs, chan->num_descs);
+	}
+
 	/* Allocate the buffer descriptors. */
-	chan->seg_v = dma_zalloc_coherent(chan->dev,
-					  sizeof(*chan->seg_v) *
-					  XILINX_DMA_NUM_DESCS,
-					  &chan->seg_p, GFP_KERNEL);
-	if (!chan->seg_v) {
+	if (xilinx_dma_alloc_bds(chan)) {
 		dev_err(chan->dev,
 			"unable to allocate channel %d descriptors\n",
 			chan->id);
 		return -ENOMEM;
 	}
 
-	for (i = 0; i < XILINX_DMA_NUM_DESCS; i++) {
-#ifdef CONFIG_PHYS_ADDR_T_64BIT
-		chan->seg_v[i].hw.next_desc =
-		lower_32_bits(chan->seg_p + sizeof(*chan->seg_v) *
-			((i + 1) % XILINX_DMA_NUM_DESCS));
-		chan->seg_v[i].hw.next_desc_msb =
-		upper_32_bits(chan->seg_p + sizeof(*chan->seg_v) *
-			((i + 1) % XILINX_DMA_NUM_DESCS));
-#else
-		chan->seg_v[i].hw.next_desc =
-			chan->seg_p + sizeof(*chan->seg_v) *
-			((i + 1) % XILINX_DMA_NUM_DESCS);
-#endif
-
-		chan->seg_v[i].phys = chan->seg_p + sizeof(*chan->seg_v) * i;
-		list_add_tail(&chan->seg_v[i].node, &chan->free_seg_list);
-	}
-
-	/*
-	 * For Cyclic DMA We need to Program the Tail Descriptor
-	 * register with some value which is not a part of the BD chain
-	 * So allocating a desc segment during channel allocation for
-	 * programming tail descriptor.
-	 */
-	chan->cyclic_seg_v = dma_zalloc_coherent(chan->dev,
-						 sizeof(*chan->cyclic_seg_v),
-						 &chan->cyclic_seg_p,
-						 GFP_KERNEL);
-	if (!chan->cyclic_seg_v) {
+	/* Link the BDs into a ring, next_desc is a full dma_addr_t. */
+	for (i = 0; i < chan->num_descs; i++)
+		chan->seg_v[i].hw->next_desc =
+			chan->seg_v[(i + 1) % chan->num_descs].phys;
+	chan->seg_head = 0;
+	chan->seg_tail = 0;
+
+	/* And the transaction descriptors, one per BD. */
+	/* About 10 MB at XILINX_DMA_MAX_DESCS, beyond what kmalloc serves. */
+	chan->descs = kvcalloc(chan->num_descs, sizeof(*chan->descs),
+			       GFP_KERNEL);
+	if (!chan->descs) {
 		dev_err(chan->dev,
-			"unable to allocate desc segment for cyclic DMA\n");
+			"unable to allocate channel %d transaction descriptors\n",
+			chan->id);
+		xilinx_dma_free_bds(chan);
 		return -ENOMEM;
 	}
-	chan->cyclic_seg_v->phys = chan->cyclic_seg_p;
+	chan->desc_head = 0;
+	chan->desc_tail = 0;
 
+	/* Cookies restart, so forget the results of the previous user. */
 	dma_cookie_init(dchan);
+	memset(chan->history, 0, sizeof(chan->history));
 
-	/* Enable interrupts */
-	dma_ctrl_set(chan, XILINX_DMA_REG_CONTROL, XILINX_DMA_XR_IRQ_ALL_MASK);
+	/* Enable interrupts, only the error interrupt when polling */
+	dma_ctrl_set(chan, XILINX_DMA_REG_CONTROL, chan->poll_period ?
+		     XILINX_DMA_XR_IRQ_ERROR_MASK : XILINX_DMA_XR_IRQ_ALL_MASK);
 
 	return 0;
 }
@@ -487,6 +836,10 @@ static void xilinx_dma_free_descriptors(struct xilinx_dma_chan *chan)
 	xilinx_dma_free_desc_list(chan, &chan->pending_list);
 	xilinx_dma_free_desc_list(chan, &chan->done_list);
 	xilinx_dma_free_desc_list(chan, &chan->active_list);
+	chan->desc_pendingcount = 0;
+	chan->dr_seg = NULL;
+	xilinx_dma_reclaim_segments(chan);
+	xilinx_dma_reclaim_descriptors(chan);
 
 	spin_unlock_irqrestore(&chan->lock, flags);
 }
@@ -500,22 +853,22 @@ static void xilinx_dma_free_chan_resources(struct dma_chan *dchan)
 	struct xilinx_dma_chan *chan = to_xilinx_chan(dchan);
 	unsigned long flags;
 
+	hrtimer_cancel(&chan->poll_timer);
 	xilinx_dma_free_descriptors(chan);
 
-	/* Remove all segments from free segment list */
+	/* Empty the segment and descriptor rings */
 	spin_lock_irqsave(&chan->lock, flags);
-	INIT_LIST_HEAD(&chan->free_seg_list);
+	chan->seg_head = 0;
+	chan->seg_tail = 0;
+	chan->desc_head = 0;
+	chan->desc_tail = 0;
 	spin_unlock_irqrestore(&chan->lock, flags);
 
-	/* Free Memory that is allocated for cyclic DMA Mode */
-	dma_free_coherent(chan->dev,
-			  sizeof(*chan->cyclic_seg_v),
-			  chan->cyclic_seg_v, chan->cyclic_seg_p);
+	kvfree(chan->descs);
+	chan->descs = NULL;
 
-	/* Free memory that was allocated for the segments */
-	dma_free_coherent(chan->dev,
-			  sizeof(*chan->seg_v) * XILINX_DMA_NUM_DESCS,
-			  chan->seg_v, chan->seg_p);
+	/* Free the segments, and the cyclic tail BD with them */
+	xilinx_dma_free_bds(chan);
 }
 
 
@@ -531,6 +884,29 @@ static void xilinx_dma_chan_desc_cleanup(struct xilinx_dma_chan *chan)
 
 	spin_lock_irqsave(&chan->lock, flags);
 
+	/* Run the callback of an active cyclic transaction once for every
+	 * period that elapsed since the last run.  The transaction may be
+	 * terminated while the lock is dropped, so look it up again every
+	 * time.
+	 */
+	desc = list_first_entry_or_null(&chan->active_list,
+					 struct xilinx_dma_tx_descriptor, node);
+	while (desc && desc->cyclic && desc->periods_elapsed) {
+		dma_async_tx_callback callback = desc->async_tx.callback;
+		void *callback_param = desc->async_tx.callback_param;
+
+		desc->periods_elapsed--;
+
+		if (callback) {
+			spin_unlock_irqrestore(&chan->lock, flags);
+			callback(callback_param);
+			spin_lock_irqsave(&chan->lock, flags);
+		}
+
+		desc = list_first_entry_or_null(&chan->active_list,
+						struct xilinx_dma_tx_descriptor, node);
+	}
+
 	while (!list_empty(&chan->done_list)) {
 		dma_async_tx_callback callback;
 		void *callback_param;
@@ -538,11 +914,10 @@ static void xilinx_dma_chan_desc_cleanup(struct xilinx_dma_chan *chan)
 		desc = list_first_entry(&chan->done_list,
 			struct xilinx_dma_tx_descriptor, node);
 
-		/* Remove from the list of running transactions */
-		if (!desc->cyclic) {			
-			list_del(&desc->node);
-		}
-
+		/* The result is already in the history for tx_status(), so a
+		 * completed transaction can be freed after its callback.
+		 */
+		list_del(&desc->node);
 
 		/* Run the link descriptor callback function */
 		callback = desc->async_tx.callback;
@@ -553,16 +928,157 @@ static void xilinx_dma_chan_desc_cleanup(struct xilinx_dma_chan *chan)
 			spin_lock_irqsave(&chan->lock, flags);
 		}
 
-		/* Run any dependencies, then free the descriptor */
-		if (!desc->cyclic) {		
-			dma_run_dependencies(&desc->async_tx);
-			xilinx_dma_free_tx_descriptor(chan, desc);
-		}
+		dma_run_dependencies(&desc->async_tx);
+		xilinx_dma_free_tx_descriptor(chan, desc);
 	}
 
+	xilinx_dma_reclaim_segments(chan);
+	xilinx_dma_reclaim_descriptors(chan);
+
 	spin_unlock_irqrestore(&chan->lock, flags);
 }
 
+/**
+ * xilinx_dma_schedule_completion - Schedule completion processing
+ * @chan: Driver specific DMA channel
+ *
+ * Context: Any
+ */
+static void xilinx_dma_schedule_completion(struct xilinx_dma_chan *chan)
+{
+	if (chan->completion_task) {
+		set_bit(0, &chan->completion_pending);
+		wake_up_process(chan->completion_task);
+	} else {
+		tasklet_schedule(&chan->tasklet);
+	}
+}
+
+/**
+ * xilinx_dma_find_desc - Find a transaction descriptor by cookie
+ * @list: Descriptor list to search, newest at the tail
+ * @cookie: Transaction identifier
+ *
+ * Context: channel lock held
+ *
+ * Return: The descriptor or NULL if not found
+ */
+static struct xilinx_dma_tx_descriptor *
+xilinx_dma_find_desc(struct list_head *list, dma_cookie_t cookie)
+{
+	struct xilinx_dma_tx_descriptor *desc;
+
+	list_for_each_entry_reverse(desc, list, node)
+		if (desc->async_tx.cookie == cookie)
+			return desc;
+
+	return NULL;
+}
+
+/**
+ * xilinx_dma_desc_transferred - Bytes transferred by a transaction
+ * @desc: dma transaction descriptor
+ * @error: Set if a BD completed with an error, may be NULL
+ *
+ * The transferred lengths in the status of the completed (Cmplt) BDs are
+ * added up to the BD with RXEOF, where the S2MM packet ended.  A packet
+ * shorter than the transaction leaves the following BDs to the next packet,
+ * so they are not counted.  MM2S BDs never have RXEOF set.
+ *
+ * Return: Bytes transferred so far
+ */
+static u32 xilinx_dma_desc_transferred(struct xilinx_dma_tx_descriptor *desc,
+				       bool *error)
+{
+	struct xilinx_dma_tx_segment *segment;
+	u32 transferred = 0;
+
+	list_for_each_entry(segment, &desc->segments, node) {
+		u32 status = segment->hw->status;
+
+		if (!(status & XILINX_DMA_BD_CMPLT))
+			break;
+
+		transferred += status & XILINX_DMA_MAX_TRANS_LEN;
+
+		if (error && (status & XILINX_DMA_BD_STS_ERR_MASK))
+			*error = true;
+
+		if (status & XILINX_DMA_BD_RXEOF)
+			break;
+	}
+
+	return transferred;
+}
+
+/**
+ * xilinx_dma_desc_app_words - Status stream APP words of an S2MM transaction
+ * @desc: dma transaction descriptor, completed
+ * @app: Filled with XILINX_DMA_NUM_APP_WORDS words
+ *
+ * The engine writes the status stream of a packet into the APP fields of the
+ * BD where the packet ended (RXEOF), the last BD if the packet filled the
+ * transaction.
+ */
+static void xilinx_dma_desc_app_words(struct xilinx_dma_tx_descriptor *desc,
+				      u32 *app)
+{
+	struct xilinx_dma_tx_segment *segment;
+
+	list_for_each_entry(segment, &desc->segments, node)
+		if ((segment->hw->status & XILINX_DMA_BD_RXEOF) ||
+		    list_is_last(&segment->node, &desc->segments))
+			break;
+
+	memcpy(app, segment->hw->app, sizeof(segment->hw->app));
+}
+
+/**
+ * xilinx_dma_cyclic_advance - Account the BDs of a cyclic transaction that completed
+ * @chan: Driver specific dma channel
+ * @desc: Active cyclic transaction
+ *
+ * The hardware ignores Cmplt in cyclic mode and keeps going round the ring,
+ * so the status of a BD is cleared once accounted for, to see it complete
+ * again on the next lap.  In direct register mode the status is written by
+ * xilinx_dma_dr_next_segment() the same way.
+ *
+ * Context: channel lock held
+ *
+ * Return: true if a period elapsed
+ */
+static bool xilinx_dma_cyclic_advance(struct xilinx_dma_chan *chan,
+				      struct xilinx_dma_tx_descriptor *desc)
+{
+	struct xilinx_dma_tx_segment *segment = desc->cur_seg;
+	bool elapsed = false;
+
+	while (READ_ONCE(segment->hw->status) & XILINX_DMA_BD_CMPLT) {
+		segment->hw->status = 0;
+
+		if (++desc->seg_in_period == desc->period_segs) {
+			desc->seg_in_period = 0;
+			if (++desc->period == desc->num_periods)
+				desc->period = 0;
+			desc->periods_elapsed++;
+			elapsed = true;
+		}
+
+		if (list_is_last(&segment->node, &desc->segments))
+			segment = list_first_entry(&desc->segments,
+						   struct xilinx_dma_tx_segment, node);
+		else
+			segment = list_next_entry(segment, node);
+	}
+	desc->cur_seg = segment;
+
+	if (desc->periods_elapsed > desc->num_periods)
+		dev_warn_ratelimited(chan->dev, "Cyclic callbacks are %u periods behind.\n",
+				     desc->periods_elapsed);
+
+	return elapsed;
+}
+
 /**
  * xilinx_dma_tx_status - Get dma transaction status
  * @dchan: DMA channel
@@ -577,31 +1093,56 @@ static enum dma_status xilinx_dma_tx_status(struct dma_chan *dchan,
 {
 	struct xilinx_dma_chan *chan = to_xilinx_chan(dchan);
 	struct xilinx_dma_tx_descriptor *desc;
-	struct xilinx_dma_tx_segment *segment;
-	struct xilinx_dma_desc_hw *hw;
+	struct xilinx_dma_tx_result *result;
 	enum dma_status ret;
 	unsigned long flags;
-	u32 residue = 0;
+	u32 residue = -1;
 
 	ret = dma_cookie_status(dchan, cookie, txstate);
-	if (ret == DMA_COMPLETE || !txstate)
-		return ret;
-
-	desc = list_last_entry(&chan->active_list,
-			       struct xilinx_dma_tx_descriptor, node);
 
+	/* The residue is requested_length - transferred_length whichever
+	 * datapath the channel uses.  A completed transaction is looked up in
+	 * the history (residue -1 if it was already overwritten), an active
+	 * one reports the BDs (or direct-register segments) done so far.
+	 */
 	spin_lock_irqsave(&chan->lock, flags);
-	if (chan->has_sg) {
-		list_for_each_entry(segment, &desc->segments, node) {
-			hw = &segment->hw;
-			residue += (hw->control - hw->status) &
-				   XILINX_DMA_MAX_TRANS_LEN;
+	if (ret == DMA_COMPLETE) {
+		result = &chan->history[cookie % XILINX_DMA_TX_HISTORY];
+		if (result->cookie == cookie) {
+			residue = result->requested_length -
+				  result->transferred_length;
+			if (result->error)
+				ret = DMA_ERROR;
+		}
+	} else {
+		desc = xilinx_dma_find_desc(&chan->active_list, cookie);
+		if (desc && desc->cyclic) {
+			/* Catch up with the hardware, the residue is what is
+			 * left of the ring from the BD being transferred.  All
+			 * but the last BD of a period have the maximum length.
+			 */
+			if (xilinx_dma_cyclic_advance(chan, desc))
+				xilinx_dma_schedule_completion(chan);
+			residue = desc->requested_length -
+				  desc->period * desc->period_len -
+				  desc->seg_in_period * chan->max_transaction_length;
+		} else if (desc) {
+			residue = desc->requested_length -
+				  xilinx_dma_desc_transferred(desc, NULL);
+		} else {
+			desc = xilinx_dma_find_desc(&chan->pending_list, cookie);
+			if (desc)
+				residue = desc->requested_length;
 		}
+
+		if (chan->paused)
+			ret = DMA_PAUSED;
 	}
 	spin_unlock_irqrestore(&chan->lock, flags);
 
 	chan->residue = residue;
-	dma_set_residue(txstate, chan->residue);
+	if (txstate)
+		dma_set_residue(txstate, chan->residue);
 
 	return ret;
 }
@@ -618,9 +1159,9 @@ static void xilinx_dma_halt(struct xilinx_dma_chan *chan)
 	dma_ctrl_clear(chan, XILINX_DMA_REG_CONTROL, XILINX_DMA_CR_RUNSTOP_MASK);
 
 	/* Wait for the hardware to halt */
-	err = xilinx_dma_poll_timeout(chan, XILINX_DMA_REG_STATUS, val,
-				      (val & XILINX_DMA_SR_HALTED_MASK), 10,
-				      XILINX_DMA_LOOP_COUNT);
+	err = xilinx_dma_poll_timeout_atomic(chan, XILINX_DMA_REG_STATUS, val,
+					     (val & XILINX_DMA_SR_HALTED_MASK),
+					     10, XILINX_DMA_LOOP_COUNT);
 
 	if (err) {
 		dev_err(chan->dev, "Cannot stop channel %p: %x\n",
@@ -628,140 +1169,359 @@ static void xilinx_dma_halt(struct xilinx_dma_chan *chan)
 		chan->err = true;
 	}
 
+	chan->running = false;
 	chan->idle = true;
 }
 
 /**
  * xilinx_dma_start - Start DMA channel
  * @chan: Driver specific DMA channel
+ *
+ * The channel stays running until it is halted, reset or stopped by an
+ * error, so a started channel is left alone.
+ *
+ * Context: channel lock held, may be called from the IRQ handler and the
+ *          poll timer
  */
 static void xilinx_dma_start(struct xilinx_dma_chan *chan)
 {
 	int err = 0;
 	u32 val;
-	
+
+	if (chan->running)
+		return;
+
 	/* Set the RUN bit in DMA Control Register. */
 	dma_ctrl_set(chan, XILINX_DMA_REG_CONTROL, XILINX_DMA_CR_RUNSTOP_MASK);
 
 	/* Wait for the hardware to start.  HALTED bit must go low in the Status Register. */
-	err = xilinx_dma_poll_timeout(chan, XILINX_DMA_REG_STATUS, val,   // poll register
-				      !(val & XILINX_DMA_SR_HALTED_MASK), // exit condition
-				      1, XILINX_DMA_LOOP_COUNT);          // loop delay and timeout
+	err = xilinx_dma_poll_timeout_atomic(chan, XILINX_DMA_REG_STATUS, val,   // poll register
+					     !(val & XILINX_DMA_SR_HALTED_MASK), // exit condition
+					     1, XILINX_DMA_LOOP_COUNT);          // loop delay and timeout
 
 	if (err) {
 		dev_err(chan->dev, "Cannot start channel %s (%p) : SR = %x\n",
 			chan->name, chan, dma_ctrl_read(chan, XILINX_DMA_REG_STATUS));
 		chan->err = true;
+		return;
 	}
+
+	chan->running = true;
 }
 
 /**
- * xilinx_dma_start_transfer - Starts DMA transfer
+ * xilinx_dma_dr_write_segment - Start the segment in flight in direct register mode
  * @chan: Driver specific channel struct pointer
  */
-static void xilinx_dma_start_transfer(struct xilinx_dma_chan *chan)
+static void xilinx_dma_dr_write_segment(struct xilinx_dma_chan *chan)
 {
-	struct xilinx_dma_tx_descriptor *head_desc, *tail_desc;
-	struct xilinx_dma_tx_segment *tail_segment;
-	struct xilinx_mcdma_config *config = &chan->config;
+	struct xilinx_dma_desc_hw *hw = chan->dr_seg->hw;
 
-	if (chan->err)
-		return;
+	dma_ctrl_write_addr(chan, XILINX_DMA_REG_SRCDSTADDR, hw->buf_addr);
 
-	if (list_empty(&chan->pending_list))
-		return;
+	/* Writing BTT starts the transfer */
+	dma_ctrl_write(chan, XILINX_DMA_REG_BTT,
+		       hw->control & chan->max_transaction_length);
+}
 
-	if (!chan->idle)
-		return;
+/**
+ * xilinx_dma_dr_advance - Account the segment in flight in direct register mode
+ * @chan: Driver specific channel struct pointer
+ *
+ * The transferred length read back from BTT is written to the status of the
+ * segment with the Cmplt bit (and RXEOF for a short S2MM segment), the way the
+ * hardware writes the BD status in SG mode, so completion and residue work the
+ * same for both datapaths.  Then @chan->dr_seg moves to the next segment of
+ * the active descriptor, if there is one (always, for a cyclic descriptor).
+ *
+ * Context: channel lock held
+ *
+ * Return: true if there is another segment to start, false if the active
+ *         descriptor is done
+ */
+static bool xilinx_dma_dr_advance(struct xilinx_dma_chan *chan)
+{
+	struct xilinx_dma_tx_segment *segment = chan->dr_seg;
+	struct xilinx_dma_tx_descriptor *desc;
+	u32 length;
 
-	head_desc = list_first_entry(&chan->pending_list,
-				     struct xilinx_dma_tx_descriptor, node);
-	tail_desc = list_last_entry(&chan->pending_list,
-				    struct xilinx_dma_tx_descriptor, node);
-	tail_segment = list_last_entry(&tail_desc->segments,
-				       struct xilinx_dma_tx_segment, node);
+	if (!segment)
+		return false;
 
-	if (chan->desc_pendingcount <= XILINX_DMA_COALESCE_MAX) {
-		u32 reg = dma_ctrl_read(chan, XILINX_DMA_REG_CONTROL);
-		reg &= ~XILINX_DMA_CR_COALESCE_MAX;
-		reg |= chan->desc_pendingcount << XILINX_DMA_CR_COALESCE_SHIFT;
-		dma_ctrl_write(chan, XILINX_DMA_REG_CONTROL, reg);
-	}
+	length = dma_ctrl_read(chan, XILINX_DMA_REG_BTT) &
+		 chan->max_transaction_length;
+	segment->hw->status = XILINX_DMA_BD_CMPLT | length;
 
-	if (chan->has_sg && !chan->mcdma) {
-		/* Setup the CURRDESC_PTR in hardware to the first (head) transaction descriptor.
-		 *
-		 * Note: This does not initiate the DMA, it only tells it where to start, 
-		 *       writing to TAILDESC_PTR initiates SG DMA.   The DMA hardware must be halted
-		 *       to write this register (DMACR.RS=0 and DMASR.Halted=1).
-		 */
-		dma_ctrl_write_addr(chan, XILINX_DMA_REG_CURDESC,
-			head_desc->async_tx.phys);
+	/* A short S2MM segment means the packet ended, which is where the
+	 * transaction ends too, as with RXEOF in SG mode.
+	 */
+	if (chan->direction == DMA_DEV_TO_MEM &&
+	    length < (segment->hw->control & chan->max_transaction_length))
+		segment->hw->status |= XILINX_DMA_BD_RXEOF;
+
+	desc = list_first_entry(&chan->active_list,
+				struct xilinx_dma_tx_descriptor, node);
+	if (!desc->cyclic &&
+	    (list_is_last(&segment->node, &desc->segments) ||
+	     (segment->hw->status & XILINX_DMA_BD_RXEOF))) {
+		chan->dr_seg = NULL;
+		return false;
 	}
 
-	if (chan->has_sg && chan->mcdma) {
-		if (chan->direction == DMA_MEM_TO_DEV) {
-			dma_ctrl_write_addr(chan, XILINX_DMA_REG_CURDESC,
-				head_desc->async_tx.phys);
-		} else {
-			if (!config->tdest) {
-				dma_ctrl_write_addr(chan, XILINX_DMA_REG_CURDESC,
-				       head_desc->async_tx.phys);
-			} else {
-				dma_ctrl_write_addr(chan,
-					XILINX_DMA_MCRX_CDESC(config->tdest),
-				       head_desc->async_tx.phys);
-			}
-		}
+	/* A cyclic transaction goes round its segments until terminated. */
+	if (list_is_last(&segment->node, &desc->segments))
+		chan->dr_seg = list_first_entry(&desc->segments,
+						struct xilinx_dma_tx_segment, node);
+	else
+		chan->dr_seg = list_next_entry(segment, node);
+
+	return true;
+}
+
+/**
+ * xilinx_dma_dr_next_segment - Complete the segment in flight in direct register mode
+ * @chan: Driver specific channel struct pointer
+ *
+ * The segment is accounted by xilinx_dma_dr_advance(), and the next one of
+ * the active descriptor started.
+ *
+ * Context: IRQ Handler, channel lock held
+ *
+ * Return: true if another segment was started, false if the active
+ *         descriptor is done
+ */
+static bool xilinx_dma_dr_next_segment(struct xilinx_dma_chan *chan)
+{
+	if (!xilinx_dma_dr_advance(chan))
+		return false;
+
+	xilinx_dma_dr_write_segment(chan);
+
+	return true;
+}
+
+/**
+ * xilinx_dma_start_transfer_dr - Starts DMA transfer in direct register mode
+ * @chan: Driver specific channel struct pointer
+ *
+ * Without SG the hardware takes one buffer at a time, so one descriptor is
+ * issued at a time and its segments are written to SRCDSTADDR and BTT one
+ * after the other by xilinx_dma_dr_next_segment().  The channel is started
+ * once and stays running, so only SRCDSTADDR and BTT are written here.
+ */
+static void xilinx_dma_start_transfer_dr(struct xilinx_dma_chan *chan)
+{
+	struct xilinx_dma_tx_descriptor *desc;
+
+	desc = list_first_entry(&chan->pending_list,
+				struct xilinx_dma_tx_descriptor, node);
+
+	if (unlikely(!chan->running)) {
+		xilinx_dma_start(chan);
+
+		if (chan->err)
+			return;
 	}
 
-	xilinx_dma_start(chan);
+	chan->idle = false;
+	chan->dr_seg = list_first_entry(&desc->segments,
+					struct xilinx_dma_tx_segment, node);
+	xilinx_dma_dr_write_segment(chan);
+
+	list_move_tail(&desc->node, &chan->active_list);
+	chan->desc_pendingcount--;
+}
+
+/**
+ * xilinx_dma_write_desc - Write the CURDESC or TAILDESC register of a channel
+ * @chan: Driver specific channel struct pointer
+ * @tail: Write TAILDESC, otherwise CURDESC
+ * @phys: Physical address of the BD
+ *
+ * The S2MM channels of a multichannel DMA, other than TDEST 0, have their own
+ * pair of registers.
+ */
+static void xilinx_dma_write_desc(struct xilinx_dma_chan *chan, bool tail,
+				  dma_addr_t phys)
+{
+	u32 reg;
+
+	if (chan->tdest)
+		reg = tail ? XILINX_DMA_MCRX_TDESC(chan->tdest) :
+			     XILINX_DMA_MCRX_CDESC(chan->tdest);
+	else
+		reg = tail ? XILINX_DMA_REG_TAILDESC : XILINX_DMA_REG_CURDESC;
+
+	dma_ctrl_write_addr(chan, reg, phys);
+}
+
+/**
+ * xilinx_dma_mcdma_s2mm - Check for an S2MM channel of a multichannel DMA
+ * @chan: Driver specific channel struct pointer, may be NULL
+ *
+ * These channels, one per TDEST, have their own BD chain but share the
+ * control and status registers of the S2MM engine.
+ *
+ * Return: true for an S2MM TDEST channel
+ */
+static bool xilinx_dma_mcdma_s2mm(struct xilinx_dma_chan *chan)
+{
+	return chan && chan->mcdma && chan->direction == DMA_DEV_TO_MEM;
+}
+
+/**
+ * xilinx_dma_can_append - Check if the pending BDs can extend the running chain
+ * @chan: Driver specific channel struct pointer
+ *
+ * The engine stops at TAILDESC with that BD already fetched, next_desc
+ * included, and a later write to TAILDESC resumes from the next_desc it read
+ * then, busy or idle.  CURDESC can only be written while the engine is halted.
+ * So pending BDs can only be appended to a running chain if the last BD issued
+ * already pointed at them, which is the case when they follow it in the ring
+ * (or were chained to it while both were pending).
+ *
+ * Context: channel lock held
+ *
+ * Return: true if the pending descriptors can be appended
+ */
+static bool xilinx_dma_can_append(struct xilinx_dma_chan *chan)
+{
+	struct xilinx_dma_tx_descriptor *pending;
+
+	if (!chan->running || chan->cyclic)
+		return false;
+
+	pending = list_first_entry(&chan->pending_list,
+				   struct xilinx_dma_tx_descriptor, node);
+
+	return chan->tail_next_p == pending->async_tx.phys;
+}
+
+/**
+ * xilinx_dma_poll_arm - Start the poll timer if the channel polls
+ * @chan: Driver specific channel struct pointer
+ *
+ * Context: channel lock held
+ */
+static void xilinx_dma_poll_arm(struct xilinx_dma_chan *chan)
+{
+	if (chan->poll_period && !hrtimer_is_queued(&chan->poll_timer))
+		hrtimer_start(&chan->poll_timer, chan->poll_period,
+			      HRTIMER_MODE_REL);
+}
+
+/**
+ * xilinx_dma_start_transfer - Starts DMA transfer
+ * @chan: Driver specific channel struct pointer
+ *
+ * In SG mode the channel is started once and stays running, a chain is
+ * extended by moving TAILDESC, so the engine doesn't go idle between
+ * submissions while descriptors keep coming.  Pending BDs that don't follow
+ * the last BD issued (submitted out of order, or prepared in between) wait
+ * for the chain to finish; the engine is then halted so they can be issued
+ * as a new chain from CURDESC.  The S2MM engine of a multichannel DMA is
+ * shared by the TDEST channels, xilinx_dma_recover_work() halts it and
+ * restarts them all.
+ */
+static void xilinx_dma_start_transfer(struct xilinx_dma_chan *chan)
+{
+	struct xilinx_dma_tx_descriptor *head_desc, *tail_desc;
+	struct xilinx_dma_tx_segment *tail_segment;
+	u32 count, delay, reg;
 
 	if (chan->err)
 		return;
 
-	/* Start the transfer */
-	chan->idle = false;	
-	if (chan->has_sg && !chan->mcdma) {
-		if (chan->cyclic) {
-			dma_ctrl_write_addr(chan, XILINX_DMA_REG_TAILDESC,
-				chan->cyclic_seg_p);
-		} else {
-			/* Write the pointer to last transaction descriptor to the TAILDESC_PTR in hardware,
-			 * which initiates the SG DMA. */
-			dma_ctrl_write_addr(chan, XILINX_DMA_REG_TAILDESC,
-			       tail_segment->phys);
+	if (chan->paused || chan->resetting)
+		return;
+
+	if (list_empty(&chan->pending_list))
+		return;
+
+	if (!chan->has_sg) {
+		if (chan->idle)
+			xilinx_dma_start_transfer_dr(chan);
+		return;
+	}
+
+	if (!xilinx_dma_can_append(chan)) {
+		if (!chan->idle)
+			return;
+
+		if (chan->running && xilinx_dma_mcdma_s2mm(chan)) {
+			WRITE_ONCE(chan->xdev->mcdma_halt, true);
+			schedule_work(&chan->xdev->recover_work);
+			return;
 		}
-	} else if (chan->has_sg && chan->mcdma) {
 
-		if (chan->direction == DMA_MEM_TO_DEV) {
-			dma_ctrl_write(chan, XILINX_DMA_REG_TAILDESC,
-			       tail_segment->phys);
-		} else {
-			if (!config->tdest) {
-				dma_ctrl_write(chan, XILINX_DMA_REG_TAILDESC,
-					       tail_segment->phys);
-			} else {
-				dma_ctrl_write(chan,
-					XILINX_DMA_MCRX_TDESC(config->tdest),
-					tail_segment->phys);
-			}
+		if (chan->running) {
+			xilinx_dma_halt(chan);
+			if (chan->err)
+				return;
 		}
-	} else {
-		struct xilinx_dma_tx_segment *segment;
-		struct xilinx_dma_desc_hw *hw;
+	}
 
-		segment = list_first_entry(&head_desc->segments,
-					   struct xilinx_dma_tx_segment, node);
-		hw = &segment->hw;
+	/* Completion follows the BD status, not the interrupts, so every
+	 * pending descriptor is issued at once.
+	 */
+	head_desc = list_first_entry(&chan->pending_list,
+				     struct xilinx_dma_tx_descriptor, node);
+	tail_desc = list_last_entry(&chan->pending_list,
+				    struct xilinx_dma_tx_descriptor, node);
+	tail_segment = list_last_entry(&tail_desc->segments,
+				       struct xilinx_dma_tx_segment, node);
 
-		dma_ctrl_write_addr(chan, XILINX_DMA_REG_SRCDSTADDR, hw->buf_addr);
+	if (chan->idle) {
+		/* Interrupt every chan->coalesce completed descriptors.  Only
+		 * the finished descriptors are completed on an interrupt, so the
+		 * threshold doesn't have to match what was issued: a low one
+		 * gets the first descriptors back sooner, a high one takes
+		 * fewer interrupts.  The delay timer catches the descriptors
+		 * that complete after the last threshold was reached.  A
+		 * cyclic transfer interrupts for every BD.
+		 */
+		count = chan->coalesce ? chan->coalesce : XILINX_DMA_COALESCE_MAX;
+		if (chan->cyclic)
+			count = 1;
+
+		delay = chan->irq_delay;
+		if (!delay && count > 1)
+			delay = 1;
+
+		reg = dma_ctrl_read(chan, XILINX_DMA_REG_CONTROL);
+		reg &= ~(XILINX_DMA_CR_COALESCE_MAX | XILINX_DMA_CR_DELAY_MAX);
+		reg |= count << XILINX_DMA_CR_COALESCE_SHIFT;
+		reg |= (delay << XILINX_DMA_CR_DELAY_SHIFT) & XILINX_DMA_CR_DELAY_MAX;
+		dma_ctrl_write(chan, XILINX_DMA_REG_CONTROL, reg);
+	}
 
-		/* Start the transfer */
-		dma_ctrl_write(chan, XILINX_DMA_REG_BTT,
-			       hw->control & XILINX_DMA_MAX_TRANS_LEN);
+	if (!chan->running) {
+		/* Setup the CURRDESC_PTR in hardware to the first (head)
+		 * transaction descriptor.
+		 *
+		 * Note: This does not initiate the DMA, it only tells it where
+		 *       to start, writing to TAILDESC_PTR initiates SG DMA.
+		 */
+		xilinx_dma_write_desc(chan, false, head_desc->async_tx.phys);
+
+		xilinx_dma_start(chan);
+
+		if (chan->err)
+			return;
 	}
 
+	/* Start the transfer.  On a running chain the BDs are already linked
+	 * to it, the writel() orders them before the new TAILDESC.
+	 */
+	chan->idle = false;
+	if (chan->cyclic)
+		xilinx_dma_write_desc(chan, true, chan->cyclic_seg_p);
+	else
+		xilinx_dma_write_desc(chan, true, tail_segment->phys);
+
+	chan->tail_next_p = tail_segment->hw->next_desc;
+	xilinx_dma_poll_arm(chan);
+
 	list_splice_tail_init(&chan->pending_list, &chan->active_list);
 	chan->desc_pendingcount = 0;
 }
@@ -781,30 +1541,231 @@ static void xilinx_dma_issue_pending(struct dma_chan *dchan)
 }
 
 /**
- * xilinx_dma_complete_descriptor - Mark the active descriptor as complete
+ * xilinx_dma_complete_descriptor - Complete the finished active descriptors
  * @chan : xilinx DMA channel
  *
+ * In SG mode descriptors are appended to the running chain, so an interrupt
+ * doesn't mean every active descriptor is done.  They are completed in order
+ * while the last BD of the descriptor has Cmplt set in its status.  In direct
+ * register mode the single active descriptor is done.  A cyclic transaction
+ * only accounts the periods that elapsed.
+ *
  * Context: IRQ Handler
  */
 static void xilinx_dma_complete_descriptor(struct xilinx_dma_chan *chan)
 {
 	struct xilinx_dma_tx_descriptor *desc, *next;
-
-	if (list_empty(&chan->active_list))
-		return;
+	struct xilinx_dma_tx_result *result;
+	dma_cookie_t cookie;
 
 	list_for_each_entry_safe(desc, next, &chan->active_list, node) {
+		/* A cyclic transaction never completes, it is alone on the
+		 * active list.
+		 */
+		if (desc->cyclic) {
+			xilinx_dma_cyclic_advance(chan, desc);
+			break;
+		}
+
+		if (chan->has_sg) {
+			struct xilinx_dma_tx_segment *tail;
+
+			tail = list_last_entry(&desc->segments,
+					       struct xilinx_dma_tx_segment, node);
+			if (!(READ_ONCE(tail->hw->status) & XILINX_DMA_BD_CMPLT))
+				break;
+
+			/* The other BDs are read after the last one completed. */
+			dma_rmb();
+
+			/* Start loading the status of the next descriptor
+			 * while this one is accounted.
+			 */
+			if (!list_is_last(&desc->node, &chan->active_list)) {
+				tail = list_last_entry(&next->segments,
+						       struct xilinx_dma_tx_segment,
+						       node);
+				prefetch(&tail->hw->status);
+			}
+		}
+
 		list_del(&desc->node);
-		if (!desc->cyclic)
-			dma_cookie_complete(&desc->async_tx);
+
+		/* Record the result for tx_status() before the cookie
+		 * completes.  Only the length is needed after that, so the BDs
+		 * go back to the ring right away.
+		 */
+		cookie = desc->async_tx.cookie;
+		result = &chan->history[cookie % XILINX_DMA_TX_HISTORY];
+		result->error = false;
+		result->transferred_length =
+			xilinx_dma_desc_transferred(desc, &result->error);
+		result->requested_length = desc->requested_length;
+		if (chan->has_sg && chan->direction == DMA_DEV_TO_MEM)
+			xilinx_dma_desc_app_words(desc, result->app);
+		if (chan->packet_mode) {
+			struct xilinx_dma_tx_segment *segment;
+
+			segment = list_first_entry(&desc->segments,
+						   struct xilinx_dma_tx_segment,
+						   node);
+			result->sof = !!(segment->hw->status & XILINX_DMA_BD_RXSOF);
+			result->eof = !!(segment->hw->status & XILINX_DMA_BD_RXEOF);
+		}
+		result->cookie = cookie;
+		xilinx_dma_free_tx_segments(chan, desc);
+
+		dma_cookie_complete(&desc->async_tx);
 		list_add_tail(&desc->node, &chan->done_list);
 	}
+
+	chan->idle = list_empty(&chan->active_list);
+}
+
+/**
+ * xilinx_dma_fail_descriptor - Complete an active descriptor with an error
+ * @chan : xilinx DMA channel
+ * @desc: Active descriptor the engine halted on
+ *
+ * The result records what was transferred before the error, and tx_status()
+ * reports DMA_ERROR for it, so the client can submit it again.
+ *
+ * Context: channel lock held
+ */
+static void xilinx_dma_fail_descriptor(struct xilinx_dma_chan *chan,
+				       struct xilinx_dma_tx_descriptor *desc)
+{
+	struct xilinx_dma_tx_result *result;
+	dma_cookie_t cookie;
+
+	list_del(&desc->node);
+
+	cookie = desc->async_tx.cookie;
+	result = &chan->history[cookie % XILINX_DMA_TX_HISTORY];
+	result->transferred_length = xilinx_dma_desc_transferred(desc, NULL);
+	result->requested_length = desc->requested_length;
+	result->error = true;
+	memset(result->app, 0, sizeof(result->app));
+	result->sof = false;
+	result->eof = false;
+	result->cookie = cookie;
+	xilinx_dma_free_tx_segments(chan, desc);
+
+	dma_cookie_complete(&desc->async_tx);
+	list_add_tail(&desc->node, &chan->done_list);
+
+	chan->dr_seg = NULL;
+	chan->idle = list_empty(&chan->active_list);
+}
+
+/**
+ * xilinx_dma_desc_has_error - Check the BDs of a descriptor for an error
+ * @desc: dma transaction descriptor
+ *
+ * Return: true if the engine wrote an error to the status of one of its BDs
+ */
+static bool xilinx_dma_desc_has_error(struct xilinx_dma_tx_descriptor *desc)
+{
+	struct xilinx_dma_tx_segment *segment;
+
+	list_for_each_entry(segment, &desc->segments, node)
+		if (READ_ONCE(segment->hw->status) & XILINX_DMA_BD_STS_ERR_MASK)
+			return true;
+
+	return false;
+}
+
+/**
+ * xilinx_dma_mcdma_complete - Complete the descriptors of every TDEST channel
+ * @xdev: Driver specific device structure
+ *
+ * The status register is shared, so whichever channel acknowledged the
+ * interrupt can't tell which TDEST it was for.  Each channel completes what
+ * the status of its own BDs shows done, which is nothing for the others.
+ *
+ * Context: IRQ Handler
+ */
+static void xilinx_dma_mcdma_complete(struct xilinx_dma_device *xdev)
+{
+	struct xilinx_dma_chan *chan;
+	int i;
+
+	for (i = 0; i < xdev->nr_channels; i++) {
+		chan = xdev->chan[i];
+		if (!xilinx_dma_mcdma_s2mm(chan))
+			continue;
+
+		spin_lock(&chan->lock);
+		xilinx_dma_complete_descriptor(chan);
+		xilinx_dma_start_transfer(chan);
+		spin_unlock(&chan->lock);
+
+		if (!list_empty(&chan->done_list))
+			xilinx_dma_schedule_completion(chan);
+	}
+}
+
+/**
+ * xilinx_dma_restart_chain - Restart an SG channel after the engine halted
+ * @chan: Driver specific channel struct pointer
+ *
+ * Halting the shared S2MM engine for one TDEST channel stops the others as
+ * well, and the error recovery resets the whole core.  The finished
+ * descriptors are completed, and the rest restarted from the first BD without
+ * Cmplt (for a cyclic transaction, the next BD of its current period); a BD
+ * that was being transferred when the engine halted is transferred again
+ * from its start.
+ *
+ * Context: channel lock held
+ */
+static void xilinx_dma_restart_chain(struct xilinx_dma_chan *chan)
+{
+	struct xilinx_dma_tx_descriptor *head, *tail;
+	struct xilinx_dma_tx_segment *segment, *tail_segment;
+	dma_addr_t tail_p;
+
+	chan->running = false;
+
+	xilinx_dma_complete_descriptor(chan);
+	if (list_empty(&chan->active_list))
+		return;
+
+	head = list_first_entry(&chan->active_list,
+				struct xilinx_dma_tx_descriptor, node);
+	tail = list_last_entry(&chan->active_list,
+			       struct xilinx_dma_tx_descriptor, node);
+	tail_segment = list_last_entry(&tail->segments,
+				       struct xilinx_dma_tx_segment, node);
+	tail_p = tail_segment->phys;
+
+	if (head->cyclic) {
+		segment = head->cur_seg;
+		tail_p = chan->cyclic_seg_p;
+	} else {
+		/* The last BD of head is not done, or it would have completed. */
+		list_for_each_entry(segment, &head->segments, node)
+			if (!(READ_ONCE(segment->hw->status) & XILINX_DMA_BD_CMPLT))
+				break;
+	}
+
+	dev_warn(chan->dev, "Channel %s restarted, a packet may be lost.\n",
+		 chan->name);
+
+	xilinx_dma_write_desc(chan, false, segment->phys);
+	xilinx_dma_start(chan);
+	xilinx_dma_write_desc(chan, true, tail_p);
+	chan->tail_next_p = tail_segment->hw->next_desc;
 }
 
 /**
  * xilinx_dma_chan_reset - Reset DMA channel
  * @chan: Driver specific DMA channel
  *
+ * The reset halts the whole core, MM2S and S2MM, and clears DMACR.  Only
+ * the state of @chan is updated, the error recovery takes care of the others.
+ *
+ * Context: Process, the poll sleeps
+ *
  * Return: '0' on success and failure value on error
  */
 static int xilinx_dma_chan_reset(struct xilinx_dma_chan *chan)
@@ -816,9 +1777,11 @@ static int xilinx_dma_chan_reset(struct xilinx_dma_chan *chan)
 
 	/* Wait for the hardware to finish reset */
 	err = xilinx_dma_poll_timeout(chan, XILINX_DMA_REG_CONTROL, val,
-				      !(val & XILINX_DMA_CR_RESET_MASK), 
+				      !(val & XILINX_DMA_CR_RESET_MASK),
 				      1, XILINX_DMA_LOOP_COUNT);
 
+	chan->running = false;
+
 	if (err) {
 		dev_err(chan->dev, "reset timeout, cr %x, sr %x\n",
 			dma_ctrl_read(chan, XILINX_DMA_REG_CONTROL),
@@ -831,6 +1794,334 @@ static int xilinx_dma_chan_reset(struct xilinx_dma_chan *chan)
 	return err;
 }
 
+/**
+ * xilinx_dma_dr_account - Account a finished segment without starting the next
+ * @chan: Driver specific channel struct pointer
+ *
+ * Used in direct register mode while the error recovery holds the channel,
+ * the recovery starts the next segment after the reset.
+ *
+ * Context: channel lock held
+ */
+static void xilinx_dma_dr_account(struct xilinx_dma_chan *chan)
+{
+	if (!chan->dr_seg)
+		return;
+
+	if (!xilinx_dma_dr_advance(chan) || chan->cyclic)
+		xilinx_dma_complete_descriptor(chan);
+}
+
+/**
+ * xilinx_dma_recover_hold - Stop a channel from starting anything new
+ * @chan: Driver specific DMA channel
+ */
+static void xilinx_dma_recover_hold(struct xilinx_dma_chan *chan)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&chan->lock, flags);
+	chan->resetting = true;
+	spin_unlock_irqrestore(&chan->lock, flags);
+}
+
+/**
+ * xilinx_dma_recover_save - Settle the active descriptors of a channel
+ * @chan: Driver specific DMA channel
+ *
+ * The descriptors the hardware finished are completed.  The one the engine
+ * halted on with an error is failed: the first unfinished descriptor of the
+ * channel that took the error interrupt, or one with an error in the status
+ * of its BDs (for a multichannel DMA the interrupt may be taken by another
+ * TDEST channel).  The others stay active and are restarted after the reset,
+ * a cyclic transaction at its current BD.
+ *
+ * Return: DMACR of the channel, without the run and reset bits
+ */
+static u32 xilinx_dma_recover_save(struct xilinx_dma_chan *chan)
+{
+	struct xilinx_dma_tx_descriptor *desc;
+	unsigned long flags;
+	u32 status, dmacr;
+
+	spin_lock_irqsave(&chan->lock, flags);
+
+	dmacr = dma_ctrl_read(chan, XILINX_DMA_REG_CONTROL);
+	status = dma_ctrl_read(chan, XILINX_DMA_REG_STATUS);
+
+	if (chan->has_sg) {
+		xilinx_dma_complete_descriptor(chan);
+	} else if (!chan->err && (status & XILINX_DMA_XR_IRQ_IOC_MASK)) {
+		dma_ctrl_write(chan, XILINX_DMA_REG_STATUS,
+			       XILINX_DMA_XR_IRQ_IOC_MASK);
+		xilinx_dma_dr_account(chan);
+	}
+
+	if (!list_empty(&chan->active_list)) {
+		desc = list_first_entry(&chan->active_list,
+					struct xilinx_dma_tx_descriptor, node);
+		if (!desc->cyclic &&
+		    (chan->err || xilinx_dma_desc_has_error(desc)))
+			xilinx_dma_fail_descriptor(chan, desc);
+	}
+
+	spin_unlock_irqrestore(&chan->lock, flags);
+
+	if (!list_empty(&chan->done_list))
+		xilinx_dma_schedule_completion(chan);
+
+	return dmacr & ~(XILINX_DMA_CR_RUNSTOP_MASK | XILINX_DMA_CR_RESET_MASK);
+}
+
+/**
+ * xilinx_dma_recover_restart - Restart a channel after the reset
+ * @chan: Driver specific DMA channel
+ * @dmacr: DMACR saved by xilinx_dma_recover_save()
+ * @err: Result of the reset
+ */
+static void xilinx_dma_recover_restart(struct xilinx_dma_chan *chan, u32 dmacr,
+				       int err)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&chan->lock, flags);
+
+	chan->resetting = false;
+	chan->running = false;
+
+	if (err) {
+		chan->err = true;
+		spin_unlock_irqrestore(&chan->lock, flags);
+		return;
+	}
+
+	/* The reset clears the interrupt enables, the coalescing and delay
+	 * settings and the cyclic BD mode as well.
+	 */
+	dma_ctrl_write(chan, XILINX_DMA_REG_CONTROL, dmacr);
+	chan->err = false;
+
+	if (chan->has_sg) {
+		xilinx_dma_restart_chain(chan);
+		if (!chan->idle)
+			xilinx_dma_poll_arm(chan);
+	} else if (chan->dr_seg) {
+		xilinx_dma_start(chan);
+		if (!chan->err)
+			xilinx_dma_dr_write_segment(chan);
+	}
+	xilinx_dma_start_transfer(chan);
+
+	spin_unlock_irqrestore(&chan->lock, flags);
+
+	if (!list_empty(&chan->done_list))
+		xilinx_dma_schedule_completion(chan);
+}
+
+/**
+ * xilinx_dma_recover_reset - Recover the DMA core from a channel error
+ * @xdev: Driver specific device structure
+ *
+ * A DMA error halts the failing engine, and the only way to get it going
+ * again is a reset of the core, which resets both MM2S and S2MM (and every
+ * TDEST channel).  So every channel is held (nothing new is issued on it),
+ * a healthy one is given XILINX_DMA_RECOVER_DRAIN_US to finish its active
+ * chain, the core is reset once, and every channel gets its DMACR back and
+ * its chain restarted where it stopped, followed by its pending descriptors.
+ * Note an MM2S packet cut short by the reset is sent again from the BD it
+ * was in, so the stream may see a truncated packet.
+ *
+ * Context: Process, the reset polls with sleeps
+ */
+static void xilinx_dma_recover_reset(struct xilinx_dma_device *xdev)
+{
+	u32 dmacr[XILINX_DMA_MAX_CHANS_PER_DEVICE];
+	struct xilinx_dma_chan *chan, *reset_chan = NULL;
+	int i, err;
+	u32 val;
+
+	for (i = 0; i < xdev->nr_channels; i++)
+		if (xdev->chan[i])
+			xilinx_dma_recover_hold(xdev->chan[i]);
+
+	for (i = 0; i < xdev->nr_channels; i++) {
+		chan = xdev->chan[i];
+		if (!chan)
+			continue;
+
+		/* The failing engine is halted, a healthy one goes idle at
+		 * the end of its chain (or segment in direct register mode).
+		 */
+		xilinx_dma_poll_timeout(chan, XILINX_DMA_REG_STATUS, val,
+					val & (XILINX_DMA_SR_HALTED_MASK |
+					       XILINX_DMA_SR_IDLE_MASK),
+					10, XILINX_DMA_RECOVER_DRAIN_US);
+
+		dmacr[i] = xilinx_dma_recover_save(chan);
+		reset_chan = chan;
+	}
+
+	if (!reset_chan)
+		return;
+
+	dev_warn(xdev->dev, "Resetting DMA core after a channel error.\n");
+
+	err = xilinx_dma_chan_reset(reset_chan);
+	if (err) {
+		dev_err(xdev->dev, "Reset failed.  Driver in-operable.\n");
+		xdev->reset_failed = true;
+	}
+
+	for (i = 0; i < xdev->nr_channels; i++)
+		if (xdev->chan[i])
+			xilinx_dma_recover_restart(xdev->chan[i], dmacr[i], err);
+}
+
+/**
+ * xilinx_dma_mcdma_halt - Halt the S2MM engine and restart its TDEST channels
+ * @xdev: Driver specific device structure
+ *
+ * For a TDEST channel whose pending BDs don't follow the last BD it issued,
+ * see xilinx_dma_start_transfer().  Halting the shared engine stops every
+ * TDEST channel, so they are all held, given XILINX_DMA_RECOVER_DRAIN_US to
+ * finish their chains, and restarted where they stopped, followed by their
+ * pending descriptors.
+ *
+ * Context: Process, the polls sleep
+ */
+static void xilinx_dma_mcdma_halt(struct xilinx_dma_device *xdev)
+{
+	struct xilinx_dma_chan *chan, *s2mm = NULL;
+	unsigned long flags;
+	int i, err;
+	u32 val;
+
+	for (i = 0; i < xdev->nr_channels; i++) {
+		chan = xdev->chan[i];
+		if (!xilinx_dma_mcdma_s2mm(chan))
+			continue;
+
+		xilinx_dma_recover_hold(chan);
+		s2mm = chan;
+	}
+
+	if (!s2mm)
+		return;
+
+	xilinx_dma_poll_timeout(s2mm, XILINX_DMA_REG_STATUS, val,
+				val & (XILINX_DMA_SR_HALTED_MASK |
+				       XILINX_DMA_SR_IDLE_MASK),
+				10, XILINX_DMA_RECOVER_DRAIN_US);
+
+	dma_ctrl_clear(s2mm, XILINX_DMA_REG_CONTROL, XILINX_DMA_CR_RUNSTOP_MASK);
+	err = xilinx_dma_poll_timeout(s2mm, XILINX_DMA_REG_STATUS, val,
+				      val & XILINX_DMA_SR_HALTED_MASK,
+				      10, XILINX_DMA_LOOP_COUNT);
+	if (err)
+		dev_err(xdev->dev, "Cannot halt the S2MM engine: %x\n",
+			dma_ctrl_read(s2mm, XILINX_DMA_REG_STATUS));
+
+	for (i = 0; i < xdev->nr_channels; i++) {
+		chan = xdev->chan[i];
+		if (!xilinx_dma_mcdma_s2mm(chan))
+			continue;
+
+		spin_lock_irqsave(&chan->lock, flags);
+		chan->resetting = false;
+		if (err) {
+			chan->err = true;
+		} else if (!chan->err) {
+			xilinx_dma_restart_chain(chan);
+			if (!chan->idle)
+				xilinx_dma_poll_arm(chan);
+			xilinx_dma_start_transfer(chan);
+		}
+		spin_unlock_irqrestore(&chan->lock, flags);
+
+		if (!list_empty(&chan->done_list))
+			xilinx_dma_schedule_completion(chan);
+	}
+}
+
+/**
+ * xilinx_dma_has_error - Check for a channel halted on an error
+ * @xdev: Driver specific device structure
+ *
+ * Return: true if any channel of @xdev is in error state
+ */
+static bool xilinx_dma_has_error(struct xilinx_dma_device *xdev)
+{
+	struct xilinx_dma_chan *chan;
+	unsigned long flags;
+	bool err = false;
+	int i;
+
+	for (i = 0; i < xdev->nr_channels && !err; i++) {
+		chan = xdev->chan[i];
+		if (!chan)
+			continue;
+
+		spin_lock_irqsave(&chan->lock, flags);
+		err = chan->err;
+		spin_unlock_irqrestore(&chan->lock, flags);
+	}
+
+	return err;
+}
+
+/**
+ * xilinx_dma_recover_work - Reset the core or halt the S2MM engine
+ * @work: recover_work of the Xilinx DMA device
+ *
+ * The reset restarts the TDEST channels as well, so it takes care of a
+ * pending S2MM halt.
+ *
+ * Context: Process
+ */
+static void xilinx_dma_recover_work(struct work_struct *work)
+{
+	struct xilinx_dma_device *xdev =
+		container_of(work, struct xilinx_dma_device, recover_work);
+	bool halt = READ_ONCE(xdev->mcdma_halt);
+
+	WRITE_ONCE(xdev->mcdma_halt, false);
+
+	if (xilinx_dma_has_error(xdev))
+		xilinx_dma_recover_reset(xdev);
+	else if (halt)
+		xilinx_dma_mcdma_halt(xdev);
+}
+
+/**
+ * xilinx_dma_poll - Polled completion of the SG descriptors
+ * @timer: Poll timer of the channel
+ *
+ * Used instead of the IOC and delay interrupts, it completes each descriptor
+ * as soon as the status of its last BD shows Cmplt, and issues the pending
+ * ones.  The timer is rearmed while descriptors are active; it is armed
+ * rather than restarted so xilinx_dma_start_transfer() can arm it as well.
+ *
+ * Return: HRTIMER_NORESTART always
+ */
+static enum hrtimer_restart xilinx_dma_poll(struct hrtimer *timer)
+{
+	struct xilinx_dma_chan *chan = container_of(timer,
+						    struct xilinx_dma_chan,
+						    poll_timer);
+	unsigned long flags;
+
+	spin_lock_irqsave(&chan->lock, flags);
+	xilinx_dma_complete_descriptor(chan);
+	xilinx_dma_start_transfer(chan);
+	if (!list_empty(&chan->done_list))
+		xilinx_dma_schedule_completion(chan);
+	if (!chan->idle)
+		xilinx_dma_poll_arm(chan);
+	spin_unlock_irqrestore(&chan->lock, flags);
+
+	return HRTIMER_NORESTART;
+}
+
 /**
  * xilinx_dma_irq_handler - DMA Interrupt handler
  * @irq: IRQ number
@@ -860,28 +2151,45 @@ static irqreturn_t xilinx_dma_irq_handler(int irq, void *data)
 			dma_ctrl_read(chan, XILINX_DMA_REG_CURDESCMSB),
 			dma_ctrl_read(chan, XILINX_DMA_REG_TAILDESC),
 			dma_ctrl_read(chan, XILINX_DMA_REG_TAILDESCMSB));
+
+		/* The engine halts itself, xilinx_dma_recover_work() resets
+		 * the core and restarts every channel.
+		 */
+		spin_lock(&chan->lock);
 		chan->err = true;
-	}
+		chan->running = false;
+		spin_unlock(&chan->lock);
 
-	/*
-	 * Device takes too long to do the transfer when user requires
-	 * responsiveness
-	 */
-	if (status & XILINX_DMA_XR_IRQ_DELAY_MASK)
-		dev_dbg(chan->dev, "Inter-packet latency too long\n");
+		schedule_work(&chan->xdev->recover_work);
+		return IRQ_HANDLED;
+	}
 
 	/*
-	 * Check if Interrupt on Complete (IOC) has occured.
+	 * Check if Interrupt on Complete (IOC) has occured, or the delay timer
+	 * expired with fewer completions than the interrupt threshold, which
+	 * is how the last BDs of a coalesced SG chain are caught.
 	 */
-	if (status & XILINX_DMA_XR_IRQ_IOC_MASK) {
+	if (xilinx_dma_mcdma_s2mm(chan) &&
+	    (status & (XILINX_DMA_XR_IRQ_IOC_MASK | XILINX_DMA_XR_IRQ_DELAY_MASK))) {
+		xilinx_dma_mcdma_complete(chan->xdev);
+	} else if ((status & XILINX_DMA_XR_IRQ_IOC_MASK) ||
+	    (chan->has_sg && (status & XILINX_DMA_XR_IRQ_DELAY_MASK))) {
 		spin_lock(&chan->lock);
-		xilinx_dma_complete_descriptor(chan);
-		chan->idle = true;
-		xilinx_dma_start_transfer(chan);
+		/* In direct register mode the next segment is started first,
+		 * a cyclic transaction still has its periods accounted.  The
+		 * error recovery starts it itself after the reset.
+		 */
+		if (!chan->has_sg && chan->resetting) {
+			xilinx_dma_dr_account(chan);
+		} else if (chan->has_sg || !xilinx_dma_dr_next_segment(chan) ||
+			   chan->cyclic) {
+			xilinx_dma_complete_descriptor(chan);
+			xilinx_dma_start_transfer(chan);
+		}
 		spin_unlock(&chan->lock);
 	}
 
-	tasklet_schedule(&chan->tasklet);
+	xilinx_dma_schedule_completion(chan);
 	return IRQ_HANDLED;
 }
 
@@ -896,6 +2204,102 @@ static void xilinx_dma_do_tasklet(unsigned long data)
 	xilinx_dma_chan_desc_cleanup(chan);
 }
 
+/**
+ * xilinx_dma_completion_thread - Completion thread of a channel
+ * @data: Pointer to the Xilinx dma channel structure
+ *
+ * Return: '0' always
+ */
+static int xilinx_dma_completion_thread(void *data)
+{
+	struct xilinx_dma_chan *chan = data;
+
+	/* The state is set before the checks, so a kthread_stop() or a
+	 * completion between them makes schedule() return at once.
+	 */
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (kthread_should_stop())
+			break;
+		if (!test_and_clear_bit(0, &chan->completion_pending)) {
+			schedule();
+			continue;
+		}
+		__set_current_state(TASK_RUNNING);
+
+		xilinx_dma_chan_desc_cleanup(chan);
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return 0;
+}
+
+/**
+ * xilinx_dma_completion_thread_start - Start the completion thread of a channel
+ * @chan: Driver specific DMA channel
+ * @node: Channel device node
+ *
+ * Completions run in a tasklet on the CPU that took the interrupt, unless
+ * the completion_thread parameter is set or the channel node has a
+ * xlnx,completion-cpu or xlnx,completion-priority property.  Then they run
+ * in a kernel thread of the channel, on the given CPU and with the given
+ * SCHED_FIFO priority (the DT properties override the parameters), so they
+ * can be kept away from other softirq load.
+ *
+ * Return: '0' on success and failure value on error
+ */
+static int xilinx_dma_completion_thread_start(struct xilinx_dma_chan *chan,
+					      struct device_node *node)
+{
+	struct sched_param param = { .sched_priority = completion_priority };
+	struct task_struct *task;
+	bool enable = completion_thread;
+	int cpu = completion_cpu;
+	u32 val;
+
+	if (!of_property_read_u32(node, "xlnx,completion-cpu", &val)) {
+		cpu = val;
+		enable = true;
+	}
+
+	if (!of_property_read_u32(node, "xlnx,completion-priority", &val)) {
+		param.sched_priority = val;
+		enable = true;
+	}
+
+	if (!enable)
+		return 0;
+
+	if (cpu >= (int)nr_cpu_ids || (cpu >= 0 && !cpu_online(cpu))) {
+		dev_err(chan->dev, "Invalid completion CPU %d.\n", cpu);
+		return -EINVAL;
+	}
+
+	if (param.sched_priority < 0 || param.sched_priority >= MAX_RT_PRIO) {
+		dev_err(chan->dev, "Invalid completion priority %d.\n",
+			param.sched_priority);
+		return -EINVAL;
+	}
+
+	/* Channels can share an IRQ (MCDMA), so the name has the channel id. */
+	task = kthread_create(xilinx_dma_completion_thread, chan, "xdma/%d-%d",
+			      chan->irq, chan->id);
+	if (IS_ERR(task))
+		return PTR_ERR(task);
+
+	/* Not kthread_bind(), so the thread survives the CPU going offline. */
+	if (cpu >= 0)
+		set_cpus_allowed_ptr(task, cpumask_of(cpu));
+
+	if (param.sched_priority)
+		sched_setscheduler(task, SCHED_FIFO, &param);
+
+	chan->completion_task = task;
+	wake_up_process(task);
+
+	return 0;
+}
+
 /**
  * append_desc_queue - Queuing descriptor
  * @chan: Driver specific dma channel
@@ -918,7 +2322,7 @@ static void append_desc_queue(struct xilinx_dma_chan *chan,
 				    struct xilinx_dma_tx_descriptor, node);
 	tail_segment = list_last_entry(&tail_desc->segments,
 				       struct xilinx_dma_tx_segment, node);
-	tail_segment->hw.next_desc = (u32)desc->async_tx.phys;
+	tail_segment->hw->next_desc = desc->async_tx.phys;
 
 	/*
 	 * Add the software descriptor and all children to the list
@@ -926,13 +2330,9 @@ static void append_desc_queue(struct xilinx_dma_chan *chan,
 	 */
 append:
 	list_add_tail(&desc->node, &chan->pending_list);
-	chan->desc_pendingcount++;
 
-	if (unlikely(chan->desc_pendingcount > XILINX_DMA_COALESCE_MAX)) {
-		dev_err(chan->dev, "desc pendingcount is too high\n");
-		chan->desc_pendingcount = XILINX_DMA_COALESCE_MAX;
-		BUG();
-	}
+	/* There is no limit here, the BD ring is the only one. */
+	chan->desc_pendingcount++;
 }
 
 /**
@@ -947,7 +2347,6 @@ static dma_cookie_t xilinx_dma_tx_submit(struct dma_async_tx_descriptor *tx)
 	struct xilinx_dma_chan *chan = to_xilinx_chan(tx->chan);
 	dma_cookie_t cookie;
 	unsigned long flags;
-	int err;
 
 	/* If the channel is in cyclic mode, then you cannot submit new transactions. */
 	if (chan->cyclic) {
@@ -955,29 +2354,102 @@ static dma_cookie_t xilinx_dma_tx_submit(struct dma_async_tx_descriptor *tx)
 		return -EBUSY;
 	}
 
-	if (chan->err) {
-		/*
-		 * If reset fails, need to hard reset the system.
-		 * Channel is no longer functional
-		 */
-		err = xilinx_dma_chan_reset(chan);
-		if (err < 0)
-			return err;
+	/* A channel in error state is recovered by xilinx_dma_recover_work(),
+	 * which issues the pending queue, so only refuse new descriptors once
+	 * the recovery gave up.
+	 */
+	if (chan->xdev->reset_failed) {
+		dev_err(chan->dev, "Reset failed for channel %s (%p).  Driver in-operable.\n",
+			chan->name, chan);
+		xilinx_dma_free_tx_descriptor(chan, desc);
+		return -EIO;
 	}
 
 	spin_lock_irqsave(&chan->lock, flags);
 
 	cookie = dma_cookie_assign(tx);
 
-	/* Put this transaction onto the tail of the pending queue */
-	append_desc_queue(chan, desc);
+	/* Put this transaction onto the tail of the pending queue */
+	append_desc_queue(chan, desc);
+
+	if (desc->cyclic)
+		chan->cyclic = true;
+
+	spin_unlock_irqrestore(&chan->lock, flags);
+
+	return cookie;
+}
+
+/**
+ * xilinx_dma_interleaved_icg - Gap after a chunk on the memory side
+ * @xt: Interleaved template pointer
+ * @i: Index of the chunk in the frame
+ *
+ * Return: The gap in bytes, the icg of the chunk unless the memory side has
+ *         its own
+ */
+static size_t xilinx_dma_interleaved_icg(struct dma_interleaved_template *xt,
+					 size_t i)
+{
+	struct data_chunk *chunk = &xt->sgl[i];
+	size_t icg;
+
+	icg = xt->dir == DMA_MEM_TO_DEV ? chunk->src_icg : chunk->dst_icg;
+
+	return icg ? icg : chunk->icg;
+}
+
+/**
+ * xilinx_dma_add_2d_segment - Add a 2D BD to an interleaved descriptor
+ * @chan: Driver specific DMA channel
+ * @desc: Transaction descriptor
+ * @addr: Memory address of the first line
+ * @hsize: Bytes per line
+ * @vsize: Number of lines
+ * @stride: Bytes from the start of a line to the start of the next
+ *
+ * Return: '0' on success and -ENOMEM when the BD ring is full
+ */
+static int xilinx_dma_add_2d_segment(struct xilinx_dma_chan *chan,
+				     struct xilinx_dma_tx_descriptor *desc,
+				     dma_addr_t addr, u32 hsize, u32 vsize,
+				     u32 stride)
+{
+	struct xilinx_mcdma_config *config = &chan->config;
+	struct xilinx_dma_tx_segment *segment, *prev_segment;
+	struct xilinx_dma_desc_hw *hw;
+
+	segment = xilinx_dma_alloc_tx_segment(chan);
+	if (!segment)
+		return -ENOMEM;
 
-	if (desc->cyclic)
-		chan->cyclic = true;
+	hw = segment->hw;
+	hw->buf_addr = addr;
+	if (chan->direction == DMA_DEV_TO_MEM)
+		hw->mcdma_fields = mm2s_mcdmarx_control(config->ax_cache,
+							config->ax_user);
+	else
+		hw->mcdma_fields = mm2s_mcdmatx_control(config->tdest,
+							config->tid,
+							config->tuser,
+							config->ax_cache,
+							config->ax_user);
 
-	spin_unlock_irqrestore(&chan->lock, flags);
+	hw->vsize_stride = (vsize << XILINX_DMA_BD_VSIZE_SHIFT) &
+			    XILINX_DMA_BD_VSIZE_MASK;
+	hw->vsize_stride |= stride & XILINX_DMA_BD_STRIDE_MASK;
+	hw->control = hsize & XILINX_DMA_BD_HSIZE_MASK;
+	desc->requested_length += hsize * vsize;
+
+	if (!list_empty(&desc->segments)) {
+		prev_segment = list_last_entry(&desc->segments,
+					       struct xilinx_dma_tx_segment,
+					       node);
+		prev_segment->hw->next_desc = segment->phys;
+	}
+	list_add_tail(&segment->node, &desc->segments);
 
-	return cookie;
+	return 0;
 }
 
 /**
@@ -987,6 +2459,12 @@ static dma_cookie_t xilinx_dma_tx_submit(struct dma_async_tx_descriptor *tx)
  * @xt: Interleaved template pointer
  * @flags: transfer ack flags
  *
+ * A frame of one chunk is a 2D BD of up to 8191 lines, as long as its line
+ * and stride fit the 16 bit HSIZE and STRIDE, more lines take more BDs.  The
+ * chunks of a frame of several chunks are transferred in stream order, so
+ * each takes its own BD (split every 65535 bytes).  An MM2S descriptor is
+ * sent as one packet.
+ *
  * Return: Async transaction descriptor on success and NULL on failure
  */
 static struct dma_async_tx_descriptor *
@@ -995,18 +2473,15 @@ xilinx_dma_prep_interleaved(struct dma_chan *dchan,
 				 unsigned long flags)
 {
 	struct xilinx_dma_chan *chan = to_xilinx_chan(dchan);
-	struct xilinx_mcdma_config *config = &chan->config;
 	struct xilinx_dma_tx_descriptor *desc;
 	struct xilinx_dma_tx_segment *segment;
-	struct xilinx_dma_desc_hw *hw;
+	size_t frame, i, line, vsize, hsize, size, off, stride;
+	dma_addr_t addr;
 
 	if (!is_slave_direction(xt->dir))
 		return NULL;
 
-	if (!xt->numf || !xt->sgl[0].size)
-		return NULL;
-
-	if (xt->frame_size != 1)
+	if (!xt->numf || !xt->frame_size)
 		return NULL;
 
 	if (xt->dir != chan->direction) {
@@ -1014,6 +2489,11 @@ xilinx_dma_prep_interleaved(struct dma_chan *dchan,
 		return NULL;
 	}		
 
+	if (chan->packet_mode) {
+		dev_dbg(chan->dev, "Interleaved transfers are not supported in packet mode.\n");
+		return NULL;
+	}
+
 	/* Allocate a transaction descriptor. */
 	desc = xilinx_dma_alloc_tx_descriptor(chan);
 	if (!desc)
@@ -1022,39 +2502,43 @@ xilinx_dma_prep_interleaved(struct dma_chan *dchan,
 	dma_async_tx_descriptor_init(&desc->async_tx, &chan->common);
 	desc->async_tx.tx_submit = xilinx_dma_tx_submit;
 
-	/* Allocate the link descriptor for DMA pool */
-	segment = xilinx_dma_alloc_tx_segment(chan);
-	if (!segment)
-		goto error;
-
-	hw = &segment->hw;
-
-	/* Fill in the descriptor */
-	if (xt->dir != DMA_MEM_TO_DEV) {
-		hw->buf_addr = xt->dst_start;  
-		hw->mcdma_fields = mm2s_mcdmarx_control(config->ax_cache,
-							config->ax_user);
+	addr = xt->dir == DMA_MEM_TO_DEV ? xt->src_start : xt->dst_start;
+	size = xt->sgl[0].size;
+	stride = size + xilinx_dma_interleaved_icg(xt, 0);
+
+	if (xt->frame_size == 1 && size &&
+	    size <= XILINX_DMA_BD_HSIZE_MAX &&
+	    stride <= XILINX_DMA_BD_STRIDE_MAX) {
+		/* The lines of a single chunk, VSIZE of them per BD */
+		for (line = 0; line < xt->numf; line += vsize) {
+			vsize = min_t(size_t, xt->numf - line,
+				      XILINX_DMA_BD_VSIZE_MAX);
+			if (xilinx_dma_add_2d_segment(chan, desc,
+						      addr + line * stride,
+						      size, vsize, stride))
+				goto error;
+		}
 	} else {
-		hw->buf_addr = xt->src_start;
-		hw->mcdma_fields = mm2s_mcdmatx_control(config->tdest,
-							config->tid,
-							config->tuser,
-							config->ax_cache,
-							config->ax_user);
+		/* Each chunk in turn, split at HSIZE */
+		for (frame = 0; frame < xt->numf; frame++) {
+			for (i = 0; i < xt->frame_size; i++) {
+				size = xt->sgl[i].size;
+				for (off = 0; off < size; off += hsize) {
+					hsize = min_t(size_t, size - off,
+						      XILINX_DMA_BD_HSIZE_MAX);
+					if (xilinx_dma_add_2d_segment(chan, desc,
+								      addr + off,
+								      hsize, 1,
+								      hsize))
+						goto error;
+				}
+				addr += size + xilinx_dma_interleaved_icg(xt, i);
+			}
+		}
 	}
 
-	hw->vsize_stride = (xt->numf << XILINX_DMA_BD_VSIZE_SHIFT) &
-			    XILINX_DMA_BD_VSIZE_MASK;
-	hw->vsize_stride |= (xt->sgl[0].icg + xt->sgl[0].size) &
-			    XILINX_DMA_BD_STRIDE_MASK;
-	hw->control = xt->sgl[0].size & XILINX_DMA_BD_HSIZE_MASK;
-
-	/*
-	 * Insert the segment into the descriptor segments
-	 * list.
-	 */
-	list_add_tail(&segment->node, &desc->segments);
-
+	if (list_empty(&desc->segments))
+		goto error;
 
 	segment = list_first_entry(&desc->segments,
 				   struct xilinx_dma_tx_segment, node);
@@ -1062,11 +2546,11 @@ xilinx_dma_prep_interleaved(struct dma_chan *dchan,
 
 	/* For the last DMA_MEM_TO_DEV transfer, set EOP */
 	if (xt->dir == DMA_MEM_TO_DEV) {
-		segment->hw.control |= XILINX_DMA_BD_SOP;
+		segment->hw->control |= XILINX_DMA_BD_SOP;
 		segment = list_last_entry(&desc->segments,
 					  struct xilinx_dma_tx_segment,
 					  node);
-		segment->hw.control |= XILINX_DMA_BD_EOP;
+		segment->hw->control |= XILINX_DMA_BD_EOP;
 	}
 
 	return &desc->async_tx;
@@ -1109,6 +2593,12 @@ static struct dma_async_tx_descriptor *xilinx_dma_prep_slave_sg(
 		return NULL;
 	}	
 
+	if (chan->packet_mode &&
+	    (sg_len != 1 || sg_dma_len(sgl) > chan->max_transaction_length)) {
+		dev_dbg(chan->dev, "A descriptor is a single BD in packet mode.\n");
+		return NULL;
+	}
+
 	/* Allocate a transaction descriptor. */
 	desc = xilinx_dma_alloc_tx_descriptor(chan);
 	if (!desc)
@@ -1135,13 +2625,25 @@ static struct dma_async_tx_descriptor *xilinx_dma_prep_slave_sg(
 			 * making sure it is less than the hw limit
 			 */
 			copy = min_t(size_t, sg_dma_len(sg) - sg_used,
-				     XILINX_DMA_MAX_TRANS_LEN);
-			hw = &segment->hw;
+				     chan->max_transaction_length);
+			hw = segment->hw;
 
 			/* Fill in the descriptor */
 			hw->buf_addr = sg_dma_address(sg) + sg_used;    // sg_dma_address(sg) is a dma_addr_t :)			
 			hw->control = copy;
 
+			/* Cache and user attributes are only part of the BD in
+			 * multichannel mode.
+			 */
+			if (chan->mcdma && direction == DMA_DEV_TO_MEM)
+				hw->mcdma_fields = mm2s_mcdmarx_control(
+					chan->config.ax_cache, chan->config.ax_user);
+			else if (chan->mcdma)
+				hw->mcdma_fields = mm2s_mcdmatx_control(
+					chan->config.tdest, chan->config.tid,
+					chan->config.tuser, chan->config.ax_cache,
+					chan->config.ax_user);
+
 			if (direction == DMA_MEM_TO_DEV) {
 				if (app_w)
 					memcpy(hw->app, app_w, sizeof(u32) *
@@ -1150,11 +2652,11 @@ static struct dma_async_tx_descriptor *xilinx_dma_prep_slave_sg(
 
 			/* Added by newest Xilinx driver, not sure if it is needed. */
 			if (prev_segment)
-				prev_segment->hw.next_desc = segment->phys;
+				prev_segment->hw->next_desc = segment->phys;
 			prev_segment = segment;
 
-
 			sg_used += copy;
+			desc->requested_length += copy;
 
 			/*
 			 * Insert the segment into the descriptor segments
@@ -1171,8 +2673,8 @@ static struct dma_async_tx_descriptor *xilinx_dma_prep_slave_sg(
 
 	/* For the last DMA_MEM_TO_DEV transfer, set EOP */
 	if (direction == DMA_MEM_TO_DEV) {
-		head_segment->hw.control |= XILINX_DMA_BD_SOP;
-		tail_segment->hw.control |= XILINX_DMA_BD_EOP;
+		head_segment->hw->control |= XILINX_DMA_BD_SOP;
+		tail_segment->hw->control |= XILINX_DMA_BD_EOP;
 	}
 
 	/* Link in the list of segements ? */
@@ -1187,11 +2689,21 @@ error:
 
 /**
  * xilinx_dma_prep_dma_cyclic - prepare descriptors for a DMA_SLAVE transaction
- * @chan: DMA channel
- * @sgl: scatterlist to transfer to/from
- * @sg_len: number of entries in @scatterlist
+ * @dchan: DMA channel
+ * @buf_addr: Physical address of the ring buffer
+ * @buf_len: Length of the ring buffer
+ * @period_len: Length of one period, the callback runs after each period
  * @direction: DMA direction
  * @flags: transfer ack flags
+ *
+ * Every period has its own BDs.  For MM2S each period is a packet (SOP on its
+ * first BD, EOP on its last), so the hardware interrupts at the end of each
+ * period; for S2MM the interrupts come with the packets of the stream.  Either
+ * way the periods are accounted from the BD status by
+ * xilinx_dma_cyclic_advance().  In direct register mode the BDs are started
+ * one after the other by the IRQ handler, going round the ring.
+ *
+ * Return: Async transaction descriptor on success and NULL on failure
  */
 static struct dma_async_tx_descriptor *xilinx_dma_prep_dma_cyclic(
 	struct dma_chan *dchan, dma_addr_t buf_addr, size_t buf_len,
@@ -1200,7 +2712,8 @@ static struct dma_async_tx_descriptor *xilinx_dma_prep_dma_cyclic(
 {
 	struct xilinx_dma_chan *chan = to_xilinx_chan(dchan);
 	struct xilinx_dma_tx_descriptor *desc;
-	struct xilinx_dma_tx_segment *segment, *tail_segment, *head_segment;
+	struct xilinx_dma_tx_segment *segment, *prev_segment = NULL;
+	struct xilinx_dma_tx_segment *head_segment, *tail_segment;
 	size_t copy, sg_used;
 	unsigned int num_periods;
 	int i;
@@ -1213,12 +2726,26 @@ static struct dma_async_tx_descriptor *xilinx_dma_prep_dma_cyclic(
 		return NULL;
 	}
 
-	if (buf_len % period_len != 0) {
+	if (!buf_len || !period_len || buf_len % period_len != 0) {
 		dev_dbg(chan->dev, "Buffer length must be a multiple of the period length.\n");
 		return NULL;
 	}
 
-	/* Determine the number of transactions????? */
+	if (chan->poll_period) {
+		dev_dbg(chan->dev, "Cyclic transfers need the completion interrupts.\n");
+		return NULL;
+	}
+
+	if (xilinx_dma_mcdma_s2mm(chan)) {
+		dev_dbg(chan->dev, "Cyclic mode would apply to every TDEST channel.\n");
+		return NULL;
+	}
+
+	if (chan->packet_mode) {
+		dev_dbg(chan->dev, "Cyclic transfers are not supported in packet mode.\n");
+		return NULL;
+	}
+
 	num_periods = buf_len / period_len;
 
 	/* Allocate a transaction descriptor. */
@@ -1228,6 +2755,10 @@ static struct dma_async_tx_descriptor *xilinx_dma_prep_dma_cyclic(
 
 	dma_async_tx_descriptor_init(&desc->async_tx, &chan->common);
 	desc->async_tx.tx_submit = xilinx_dma_tx_submit;
+	desc->period_len = period_len;
+	desc->num_periods = num_periods;
+	desc->period_segs = DIV_ROUND_UP(period_len,
+					 chan->max_transaction_length);
 
 	for (i = 0; i < num_periods; ++i) {
 		sg_used = 0;
@@ -1245,12 +2776,25 @@ static struct dma_async_tx_descriptor *xilinx_dma_prep_dma_cyclic(
 			 * making sure it is less than the hw limit
 			 */
 			copy = min_t(size_t, period_len - sg_used,
-				     XILINX_DMA_MAX_TRANS_LEN);
-			hw = &segment->hw;
+				     chan->max_transaction_length);
+			hw = segment->hw;
 			hw->buf_addr = buf_addr + sg_used + (period_len*i);
 			hw->control = copy;
 
+			/* Each MM2S period is a packet. */
+			if (direction == DMA_MEM_TO_DEV) {
+				if (!sg_used)
+					hw->control |= XILINX_DMA_BD_SOP;
+				if (sg_used + copy == period_len)
+					hw->control |= XILINX_DMA_BD_EOP;
+			}
+
+			if (prev_segment)
+				prev_segment->hw->next_desc = segment->phys;
+			prev_segment = segment;
+
 			sg_used += copy;
+			desc->requested_length += copy;
 
 			/*
 			 * Insert the segment into the descriptor segments
@@ -1262,42 +2806,45 @@ static struct dma_async_tx_descriptor *xilinx_dma_prep_dma_cyclic(
 
 	head_segment = list_first_entry(&desc->segments,
 					struct xilinx_dma_tx_segment, node);
-	desc->async_tx.phys = head_segment->phys;
-	desc->cyclic = true;
-	dma_ctrl_set(chan, XILINX_DMA_REG_CONTROL, XILINX_DMA_CR_CYCLIC_BD_EN_MASK);
-
 	tail_segment = list_last_entry(&desc->segments,
 					struct xilinx_dma_tx_segment, node);
-	tail_segment->hw.next_desc = head_segment->phys;
-
-	/* Set SOP (start of packet) for first transfer (head), and
-	 * set EOP (end of packet) for the last transfer (tail), but 
-	 * this is only needed when in DMA_MEM_TO_DEV mode. */
-	if (direction == DMA_MEM_TO_DEV) {
-		head_segment->hw.control |= XILINX_DMA_BD_SOP;
-		tail_segment->hw.control |= XILINX_DMA_BD_EOP;
-	}
 
 	/* Loop-back the tail transfer to the head transfer. */
-	tail_segment->hw.next_desc = head_segment->phys;
+	tail_segment->hw->next_desc = head_segment->phys;
+
+	desc->async_tx.phys = head_segment->phys;
+	desc->cur_seg = head_segment;
+	desc->cyclic = true;
+
+	if (chan->has_sg)
+		dma_ctrl_set(chan, XILINX_DMA_REG_CONTROL,
+			     XILINX_DMA_CR_CYCLIC_BD_EN_MASK);
 
 	return &desc->async_tx;
 
 error:
 	xilinx_dma_free_tx_descriptor(chan, desc);
 	return NULL;
-
 }
 
 /**
  * xilinx_dma_terminate_all - Halt the channel and free descriptors
  * @dchan: DMA Channel pointer
  *
+ * The S2MM TDEST channels of a multichannel DMA share one engine, the other
+ * channels are restarted where they stopped.
+ *
  * Return: '0' always
  */
 static int xilinx_dma_terminate_all(struct dma_chan *dchan)
 {
 	struct xilinx_dma_chan *chan = to_xilinx_chan(dchan);
+	struct xilinx_dma_device *xdev = chan->xdev;
+	struct xilinx_dma_chan *other;
+	unsigned long flags;
+	int i;
+
+	hrtimer_cancel(&chan->poll_timer);
 
 	/* Halt the DMA engine */
 	xilinx_dma_halt(chan);
@@ -1308,6 +2855,126 @@ static int xilinx_dma_terminate_all(struct dma_chan *dchan)
 		dma_ctrl_clear(chan, XILINX_DMA_REG_CONTROL, XILINX_DMA_CR_CYCLIC_BD_EN_MASK);
 		chan->cyclic = false;
 	}
+	chan->paused = false;
+
+	if (!xilinx_dma_mcdma_s2mm(chan))
+		return 0;
+
+	for (i = 0; i < xdev->nr_channels; i++) {
+		other = xdev->chan[i];
+		if (other == chan || !xilinx_dma_mcdma_s2mm(other))
+			continue;
+
+		spin_lock_irqsave(&other->lock, flags);
+		xilinx_dma_restart_chain(other);
+		xilinx_dma_start_transfer(other);
+		spin_unlock_irqrestore(&other->lock, flags);
+
+		if (!list_empty(&other->done_list))
+			xilinx_dma_schedule_completion(other);
+	}
+
+	return 0;
+}
+
+/**
+ * xilinx_dma_pause - Stop issuing descriptors
+ * @dchan: DMA Channel pointer
+ *
+ * The descriptors already issued to the hardware are left to complete.
+ * Pending descriptors stay queued, and are issued once the channel is resumed.  A
+ * cyclic transfer can't be paused without halting the channel, which would
+ * lose its position, so that is refused.
+ *
+ * Return: '0' on success and -EPERM for a cyclic channel
+ */
+static int xilinx_dma_pause(struct dma_chan *dchan)
+{
+	struct xilinx_dma_chan *chan = to_xilinx_chan(dchan);
+	unsigned long flags;
+	int ret = 0;
+
+	spin_lock_irqsave(&chan->lock, flags);
+	if (chan->cyclic)
+		ret = -EPERM;
+	else
+		chan->paused = true;
+	spin_unlock_irqrestore(&chan->lock, flags);
+
+	return ret;
+}
+
+/**
+ * xilinx_dma_resume - Resume issuing descriptors after xilinx_dma_pause()
+ * @dchan: DMA Channel pointer
+ *
+ * Return: '0' always
+ */
+static int xilinx_dma_resume(struct dma_chan *dchan)
+{
+	struct xilinx_dma_chan *chan = to_xilinx_chan(dchan);
+	unsigned long flags;
+
+	spin_lock_irqsave(&chan->lock, flags);
+	chan->paused = false;
+	xilinx_dma_start_transfer(chan);
+	spin_unlock_irqrestore(&chan->lock, flags);
+
+	return 0;
+}
+
+/**
+ * xilinx_dma_device_config - Configure the DMA channel
+ * @dchan: DMA channel
+ * @config: channel configuration
+ *
+ * The burst size in the direction of the channel (src_maxburst for S2MM,
+ * dst_maxburst for MM2S) selects the interrupt coalescing: the number of
+ * completed descriptors per interrupt (1 to 255, 0 for the maximum), from the
+ * next time the channel starts from idle.  The delay timer is set by
+ * xilinx_dma_channel_set_irq_delay(), as struct dma_slave_config has no field
+ * for it, and the AXCACHE/ARUSER attributes of the BDs by
+ * xilinx_dma_channel_mcdma_set_config().
+ *
+ * Return: '0' on success and -EINVAL on an unsupported configuration
+ */
+static int xilinx_dma_device_config(struct dma_chan *dchan,
+				    struct dma_slave_config *config)
+{
+	struct xilinx_dma_chan *chan = to_xilinx_chan(dchan);
+	enum dma_slave_buswidth addr_width;
+	unsigned long flags;
+	u32 burst;
+
+	if (is_slave_direction(config->direction) &&
+	    config->direction != chan->direction) {
+		dev_dbg(chan->dev, "Direction of config and channel must be the same.\n");
+		return -EINVAL;
+	}
+
+	if (chan->direction == DMA_DEV_TO_MEM) {
+		addr_width = config->src_addr_width;
+		burst = config->src_maxburst;
+	} else {
+		addr_width = config->dst_addr_width;
+		burst = config->dst_maxburst;
+	}
+
+	if (addr_width > chan->width) {
+		dev_dbg(chan->dev, "Address width %d wider than the stream (%d).\n",
+			addr_width, chan->width);
+		return -EINVAL;
+	}
+
+	if (burst > XILINX_DMA_COALESCE_MAX) {
+		dev_dbg(chan->dev, "Burst %d larger than the coalesce maximum.\n",
+			burst);
+		return -EINVAL;
+	}
+
+	spin_lock_irqsave(&chan->lock, flags);
+	chan->coalesce = burst;
+	spin_unlock_irqrestore(&chan->lock, flags);
 
 	return 0;
 }
@@ -1324,8 +2991,12 @@ static void xilinx_dma_chan_remove(struct xilinx_dma_chan *chan)
 	if (chan->irq > 0)
 		free_irq(chan->irq, chan);
 
+	hrtimer_cancel(&chan->poll_timer);
 	tasklet_kill(&chan->tasklet);
 
+	if (chan->completion_task)
+		kthread_stop(chan->completion_task);
+
 	list_del(&chan->common.device_node);
 }
 
@@ -1344,6 +3015,135 @@ int xilinx_dma_channel_mcdma_set_config(struct dma_chan *dchan,
 }
 EXPORT_SYMBOL(xilinx_dma_channel_mcdma_set_config);
 
+/**
+ * xilinx_dma_channel_set_irq_delay - Set the interrupt delay timer of a channel
+ * @dchan: DMA channel
+ * @delay: IRQDelay in units of 125 stream clocks (0 to 255), 0 for the
+ *         minimum needed by coalescing
+ *
+ * The delay timer interrupt completes the descriptors left below the
+ * coalescing threshold when the traffic stops.  Like the threshold, it is
+ * written the next time the channel starts from idle.
+ *
+ * Return: '0' on success and -EINVAL for a delay out of range
+ */
+int xilinx_dma_channel_set_irq_delay(struct dma_chan *dchan, u32 delay)
+{
+	struct xilinx_dma_chan *chan = to_xilinx_chan(dchan);
+	unsigned long flags;
+
+	if (delay > XILINX_DMA_COALESCE_MAX) {
+		dev_dbg(chan->dev, "Delay %u larger than the delay timer maximum.\n",
+			delay);
+		return -EINVAL;
+	}
+
+	spin_lock_irqsave(&chan->lock, flags);
+	chan->irq_delay = delay;
+	spin_unlock_irqrestore(&chan->lock, flags);
+
+	return 0;
+}
+EXPORT_SYMBOL(xilinx_dma_channel_set_irq_delay);
+
+/**
+ * xilinx_dma_find_result - Result of a completed transaction in the history
+ * @chan: Driver specific DMA channel
+ * @cookie: Transaction identifier
+ *
+ * Context: channel lock held
+ *
+ * Return: The result, or NULL if the transaction is not complete or was
+ *         overwritten
+ */
+static struct xilinx_dma_tx_result *
+xilinx_dma_find_result(struct xilinx_dma_chan *chan, dma_cookie_t cookie)
+{
+	struct xilinx_dma_tx_result *result;
+
+	result = &chan->history[cookie % XILINX_DMA_TX_HISTORY];
+	if (result->cookie != cookie ||
+	    dma_cookie_status(&chan->common, cookie, NULL) != DMA_COMPLETE)
+		return NULL;
+
+	return result;
+}
+
+/**
+ * xilinx_dma_get_app_words - Status stream APP words of a completed transaction
+ * @dchan: DMA channel, S2MM in scatter-gather mode
+ * @cookie: Transaction identifier
+ * @app: Filled with the XILINX_DMA_NUM_APP_WORDS (5) words
+ *
+ * The words are the per-packet metadata the core received on its status
+ * stream, such as a timestamp or a checksum; they are only meaningful if the
+ * core was built with the status/control stream.  They are kept with the
+ * result of the transaction, so they can be read from its callback.
+ *
+ * Return: '0' on success, -ENOENT if the transaction is not complete or has
+ *         left the history, -EINVAL for a channel without status stream
+ */
+int xilinx_dma_get_app_words(struct dma_chan *dchan, dma_cookie_t cookie,
+			     u32 *app)
+{
+	struct xilinx_dma_chan *chan = to_xilinx_chan(dchan);
+	struct xilinx_dma_tx_result *result;
+	unsigned long flags;
+	int ret = -ENOENT;
+
+	if (!chan->has_sg || chan->direction != DMA_DEV_TO_MEM)
+		return -EINVAL;
+
+	spin_lock_irqsave(&chan->lock, flags);
+	result = xilinx_dma_find_result(chan, cookie);
+	if (result) {
+		memcpy(app, result->app, sizeof(result->app));
+		ret = 0;
+	}
+	spin_unlock_irqrestore(&chan->lock, flags);
+
+	return ret;
+}
+EXPORT_SYMBOL(xilinx_dma_get_app_words);
+
+/**
+ * xilinx_dma_get_packet_bounds - Packet boundaries of a completed transaction
+ * @dchan: DMA channel, S2MM in packet mode
+ * @cookie: Transaction identifier
+ * @sof: Set if a packet starts in the BD of the transaction
+ * @eof: Set if a packet ends in the BD of the transaction
+ *
+ * In packet mode every transaction is one BD, and the engine fills them in
+ * order, so a packet is the run of transactions from one with @sof to one
+ * with @eof.  Its length is the sum of their transferred lengths.
+ *
+ * Return: '0' on success, -ENOENT if the transaction is not complete or has
+ *         left the history, -EINVAL for a channel not in packet mode
+ */
+int xilinx_dma_get_packet_bounds(struct dma_chan *dchan, dma_cookie_t cookie,
+				 bool *sof, bool *eof)
+{
+	struct xilinx_dma_chan *chan = to_xilinx_chan(dchan);
+	struct xilinx_dma_tx_result *result;
+	unsigned long flags;
+	int ret = -ENOENT;
+
+	if (!chan->packet_mode)
+		return -EINVAL;
+
+	spin_lock_irqsave(&chan->lock, flags);
+	result = xilinx_dma_find_result(chan, cookie);
+	if (result) {
+		*sof = result->sof;
+		*eof = result->eof;
+		ret = 0;
+	}
+	spin_unlock_irqrestore(&chan->lock, flags);
+
+	return ret;
+}
+EXPORT_SYMBOL(xilinx_dma_get_packet_bounds);
+
 /**
  * xilinx_dma_chan_probe - Per Channel Probing
  * It get channel features from the device tree entry and
@@ -1352,20 +3152,29 @@ EXPORT_SYMBOL(xilinx_dma_channel_mcdma_set_config);
  * @xdev: Driver specific device structure
  * @node: Device node
  * @chan_id: Channel id
+ * @tdest: Index of the channel in its node, the TDEST of an S2MM channel in
+ *         multichannel mode
  *
  * Return: '0' on success and failure value on error
  */
 static int xilinx_dma_chan_probe(struct xilinx_dma_device *xdev,
-				 struct device_node *node, int chan_id)
+				 struct device_node *node, int chan_id,
+				 int tdest)
 {
 	struct xilinx_dma_chan *chan;
 	bool has_dre;
-	u32 width;
+	u32 width, num = 0, poll;
 	int err;
 
 	/* Read parameters from device tree. */
 	has_dre = of_property_read_bool(node, "xlnx,include-dre");
 
+	if (!of_property_read_u32(node, "xlnx,num-descs", &num) &&
+	    (num < 2 || num > XILINX_DMA_MAX_DESCS)) {
+		dev_err(xdev->dev, "Invalid xlnx,num-descs %u.\n", num);
+		return -EINVAL;
+	}
+
 	err = of_property_read_u32(node, "xlnx,datawidth", &width);
 	if (err) {
 		dev_err(xdev->dev, "Missing datawidth property.\n");
@@ -1392,25 +3201,35 @@ static int xilinx_dma_chan_probe(struct xilinx_dma_device *xdev,
 	/* Initialize parameters */
 	chan->dev = xdev->dev;
 	chan->xdev = xdev;
-	chan->has_sg = xdev->has_sg;
 	chan->mcdma = xdev->mcdma;
 	chan->desc_pendingcount = 0x0;
 	chan->idle = true;	
+	chan->width = width;
+	chan->coalesce = 0;
+	chan->irq_delay = min_t(u32, irq_delay, XILINX_DMA_COALESCE_MAX);
+	chan->of_num_descs = num;
 
 	if (of_device_is_compatible(node, "xlnx,axi-dma-mm2s-channel")) {
 		/* Set channel as a Memory to Stream */
 		chan->direction = DMA_MEM_TO_DEV;
 		chan->id = chan_id;
-		chan->tdest = chan_id;
 		chan->ctrl_offset = XILINX_DMA_MM2S_CTRL_OFFSET;
 		chan->name = "xilinx-dma-mm2s";
 	} else if (of_device_is_compatible(node, "xlnx,axi-dma-s2mm-channel")) {
 		/* Set channel as a Stream to Memory */
 		chan->direction = DMA_DEV_TO_MEM;
 		chan->id = chan_id;
-		chan->tdest = chan_id - xdev->nr_channels;
 		chan->ctrl_offset = XILINX_DMA_S2MM_CTRL_OFFSET;
 		chan->name = "xilinx-dma-s2mm";
+		chan->packet_mode = of_property_read_bool(node,
+						"xlnx,s2mm-packet-mode");
+		if (chan->mcdma) {
+			chan->tdest = tdest;
+			chan->name = devm_kasprintf(xdev->dev, GFP_KERNEL,
+						    "xilinx-dma-s2mm-%d", tdest);
+			if (!chan->name)
+				return -ENOMEM;
+		}
 	} else {
 		/* Incompatible channel. */
 		dev_err(xdev->dev, "Invalid channel compatible node.\n");
@@ -1421,23 +3240,85 @@ static int xilinx_dma_chan_probe(struct xilinx_dma_device *xdev,
 	INIT_LIST_HEAD(&chan->pending_list);
 	INIT_LIST_HEAD(&chan->done_list);
 	INIT_LIST_HEAD(&chan->active_list);
-	INIT_LIST_HEAD(&chan->free_seg_list);
 
-	/* Reset the hardware. */
-	err = xilinx_dma_chan_reset(chan);
-	if (err) {
-		dev_err(xdev->dev, "Reset channel failed.\n");
-		return err;
-	}	
+	/* Let clients (eg axis-reader) find the channel by direction. */
+	chan->peri_id = XILINX_DMA_PERIPHERAL_ID | chan->direction;
+	chan->common.private = &chan->peri_id;
+
+	/* Reset the hardware, once for the TDEST channels sharing the engine. */
+	if (!tdest) {
+		err = xilinx_dma_chan_reset(chan);
+		if (err) {
+			dev_err(xdev->dev, "Reset channel failed.\n");
+			return err;
+		}
+	}
+
+	/* Select the datapath from the hardware rather than the device tree.
+	 * The DMA is reset and halted, so BTT can be written without starting
+	 * anything.  In direct-register mode it reads back the mask of its
+	 * width, in SG mode the register does not exist and reads 0.
+	 */
+	dma_ctrl_write(chan, XILINX_DMA_REG_BTT, 0xFFFFFFFF);
+	chan->max_transaction_length = dma_ctrl_read(chan, XILINX_DMA_REG_BTT);
+	dma_ctrl_write(chan, XILINX_DMA_REG_BTT, 0x00000000);
+
+	chan->has_sg = (chan->max_transaction_length == 0);
+	if (chan->has_sg)
+		chan->max_transaction_length = XILINX_DMA_MAX_TRANS_LEN;
+
+	if (chan->has_sg != xdev->has_sg)
+		dev_warn(xdev->dev, "Channel %s is in %s mode, but the device tree says otherwise.\n",
+			 chan->name, chan->has_sg ? "scatter-gather" : "direct-register");
+
+	if (chan->packet_mode && !chan->has_sg) {
+		dev_warn(xdev->dev, "Channel %s has no BDs, packet mode ignored.\n",
+			 chan->name);
+		chan->packet_mode = false;
+	}
 
-	/* Find the IRQ line, if it exists in the device tree */
-	chan->irq = irq_of_parse_and_map(node, 0);
+	if (chan->mcdma && !chan->has_sg) {
+		dev_err(xdev->dev, "Multichannel DMA needs scatter-gather mode.\n");
+		return -EINVAL;
+	}
+
+	/* Polled completion, the node overrides the poll_us module parameter */
+	if (of_property_read_u32(node, "xlnx,poll-us", &poll))
+		poll = poll_us;
+	if (poll && !chan->has_sg) {
+		dev_warn(xdev->dev, "Channel %s can't poll without scatter-gather, using interrupts.\n",
+			 chan->name);
+		poll = 0;
+	}
+	chan->poll_period = ns_to_ktime((u64)poll * NSEC_PER_USEC);
+	hrtimer_init(&chan->poll_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	chan->poll_timer.function = xilinx_dma_poll;
+
+	/* BDs in on-chip memory if the node points to a pool */
+	chan->bd_pool = of_gen_pool_get(node, "xlnx,bd-pool", 0);
+	if (!chan->bd_pool && of_find_property(node, "xlnx,bd-pool", NULL))
+		dev_warn(xdev->dev, "Channel %s BD pool not found, using DDR.\n",
+			 chan->name);
+
+	/* Find the IRQ line, if it exists in the device tree.  The TDEST
+	 * channels may have one each, or share the first.
+	 */
+	chan->irq = irq_of_parse_and_map(node, chan->tdest);
+	if (!chan->irq)
+		chan->irq = irq_of_parse_and_map(node, 0);
+
+	/* Move completion processing to a thread if configured */
+	err = xilinx_dma_completion_thread_start(chan, node);
+	if (err)
+		return err;
 
 	/* Request the interrupt and link it to a handler */
 	err = request_irq(chan->irq, xilinx_dma_irq_handler,
 			  IRQF_SHARED, chan->name, chan);
 	if (err) {
 		dev_err(xdev->dev, "Unable to request IRQ %d.\n", chan->irq);
+		if (chan->completion_task)
+			kthread_stop(chan->completion_task);
 		return err;
 	}
 
@@ -1452,6 +3333,10 @@ static int xilinx_dma_chan_probe(struct xilinx_dma_device *xdev,
 	list_add_tail(&chan->common.device_node, &xdev->common.channels);
 	xdev->chan[chan->id] = chan;
 
+	dev_info(xdev->dev, "Probed channel %s with IRQ %d in %s mode.\n",
+		 chan->name, chan->irq,
+		 chan->has_sg ? "scatter-gather" : "direct-register");
+
 	return 0;
 }
 
@@ -1475,10 +3360,27 @@ static int xilinx_dma_channel_probe(struct xilinx_dma_device *xdev,
 		return ret;
 	}
 
-	xdev->nr_channels += nr_channels;
+	/* Only S2MM has a BD chain per TDEST, MM2S takes it from each BD. */
+	if (nr_channels < 1 ||
+	    nr_channels > (xdev->mcdma ? XILINX_DMA_MCDMA_MAX_CHANS : 1) ||
+	    (nr_channels > 1 &&
+	     !of_device_is_compatible(node, "xlnx,axi-dma-s2mm-channel"))) {
+		dev_err(xdev->dev, "Invalid dma-channels %d.\n", nr_channels);
+		return -EINVAL;
+	}
+
+	if (xdev->chan_id + nr_channels > XILINX_DMA_MAX_CHANS_PER_DEVICE) {
+		dev_err(xdev->dev, "Too many channels.\n");
+		return -EINVAL;
+	}
 
-	for (i = 0; i < nr_channels; i++)
-		xilinx_dma_chan_probe(xdev, node, xdev->chan_id++);
+	/* Count each channel as it is probed, so a failure removes them. */
+	for (i = 0; i < nr_channels; i++) {
+		ret = xilinx_dma_chan_probe(xdev, node, xdev->chan_id, i);
+		if (ret)
+			return ret;
+		xdev->nr_channels = ++xdev->chan_id;
+	}
 
 	return 0;
 }
@@ -1544,6 +3446,9 @@ static int xilinx_dma_probe(struct platform_device *pdev)
 	if (xdev->mcdma)
 		xdev->common.device_prep_interleaved_dma =
 					xilinx_dma_prep_interleaved;
+	xdev->common.device_config = xilinx_dma_device_config;
+	xdev->common.device_pause = xilinx_dma_pause;
+	xdev->common.device_resume = xilinx_dma_resume;
 	xdev->common.device_terminate_all = xilinx_dma_terminate_all;
 	xdev->common.device_issue_pending = xilinx_dma_issue_pending;
 	xdev->common.device_alloc_chan_resources =
@@ -1555,6 +3460,7 @@ static int xilinx_dma_probe(struct platform_device *pdev)
 	xdev->common.residue_granularity = DMA_RESIDUE_GRANULARITY_SEGMENT;
 	xdev->common.dev = &pdev->dev;
 	xdev->chan_id = 0;
+	INIT_WORK(&xdev->recover_work, xilinx_dma_recover_work);
 
 	platform_set_drvdata(pdev, xdev);
 
@@ -1580,6 +3486,8 @@ static int xilinx_dma_probe(struct platform_device *pdev)
 	return 0;
 
 free_chan_resources:
+	cancel_work_sync(&xdev->recover_work);
+
 	for (i = 0; i < xdev->nr_channels; i++)
 		if (xdev->chan[i])
 			xilinx_dma_chan_remove(xdev->chan[i]);
@@ -1601,6 +3509,8 @@ static int xilinx_dma_remove(struct platform_device *pdev)
 	of_dma_controller_free(pdev->dev.of_node);
 	dma_async_device_unregister(&xdev->common);
 
+	cancel_work_sync(&xdev->recover_work);
+
 	for (i = 0; i < xdev->nr_channels; i++)
 		if (xdev->chan[i])
 			xilinx_dma_chan_remove(xdev->chan[i]);
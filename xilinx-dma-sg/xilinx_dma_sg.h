@@ -0,0 +1,28 @@
+/*
+ * Xilinx AXI DMA (xilinx-dma-sg) client interface
+ *
+ * Functions exported by the xilinx-dma-sg driver for its dmaengine clients,
+ * for what the generic dmaengine API can't express.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef __XILINX_DMA_SG_H
+#define __XILINX_DMA_SG_H
+
+#include <linux/dmaengine.h>
+#include <linux/types.h>
+
+/* APP words of the status stream, per S2MM packet */
+#define XILINX_DMA_NUM_APP_WORDS	5
+
+int xilinx_dma_get_app_words(struct dma_chan *dchan, dma_cookie_t cookie,
+			     u32 *app);
+int xilinx_dma_get_packet_bounds(struct dma_chan *dchan, dma_cookie_t cookie,
+				 bool *sof, bool *eof);
+int xilinx_dma_channel_set_irq_delay(struct dma_chan *dchan, u32 delay);
+
+#endif /* __XILINX_DMA_SG_H */